@@ -0,0 +1,139 @@
+#include "pch.h"
+#include "EndpointRegistry.hpp"
+#include "Platform.hpp"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+namespace {
+    const char Magic[4] = { 'J', 'S', 'R', 'G' };
+
+    uint64_t WallClockMillis() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+}
+
+EndpointRegistry::EndpointRegistry() : slot(nullptr) {
+}
+
+EndpointRegistry::~EndpointRegistry() {
+    Unregister();
+}
+
+std::string EndpointRegistry::Path() {
+    std::string configured = EnvironmentVariable("JSHELL_REGISTRY");
+    return configured.empty() ? TempDirectory() + "jshell-registry" : configured;
+}
+
+bool EndpointRegistry::Register(const std::string& endpoint) {
+    if (slot) {
+        return true;
+    }
+    if (endpoint.size() >= sizeof(slot->endpoint)) {
+        std::cerr << "Endpoint name too long to register: " << endpoint << std::endl;
+        return false;
+    }
+
+    std::string path = Path();
+    if (!file.Open(path, sizeof(RegistryHeader) + SlotCount * sizeof(RegistrySlot), true)) {
+        std::cerr << "Failed to open the endpoint registry " << path << ". Error Code: " << LastErrorCode() << std::endl;
+        return false;
+    }
+
+    // A new file is all zeroes. Every server writes the same header, so racing to create
+    // it is harmless; a file from an incompatible version is left to the servers using it.
+    RegistryHeader* header = reinterpret_cast<RegistryHeader*>(file.Data());
+    static const char Empty[4] = { 0, 0, 0, 0 };
+    if (memcmp(header->magic, Empty, sizeof(Empty)) == 0) {
+        header->version = Version;
+        header->slotCount = SlotCount;
+        header->slotSize = sizeof(RegistrySlot);
+        memcpy(header->magic, Magic, sizeof(Magic));
+    }
+    if (memcmp(header->magic, Magic, sizeof(Magic)) != 0 || header->version != Version
+        || header->slotCount != SlotCount || header->slotSize != sizeof(RegistrySlot)) {
+        std::cerr << "Endpoint registry " << path << " has an unknown layout; not registering." << std::endl;
+        file.Close(file.Capacity());
+        return false;
+    }
+
+    RegistrySlot* slots = reinterpret_cast<RegistrySlot*>(file.Data() + sizeof(RegistryHeader));
+    uint32_t pid = CurrentProcessId();
+    uint64_t now = WallClockMillis();
+    // A slot left by an earlier injection into this process comes first, then free ones,
+    // then slots of processes that are gone.
+    for (uint32_t i = 0; i < SlotCount && !slot; i++) {
+        if (slots[i].pid == pid) {
+            slot = &slots[i];
+        }
+    }
+    for (uint32_t i = 0; i < SlotCount && !slot; i++) {
+        if (slots[i].pid == 0 && Claim(slots[i], 0, pid, now)) {
+            slot = &slots[i];
+        }
+    }
+    for (uint32_t i = 0; i < SlotCount && !slot; i++) {
+        uint32_t owner = slots[i].pid;
+        uint64_t heartbeat = slots[i].heartbeatMillis;
+        bool silent = heartbeat < now && now - heartbeat > StaleMillis;
+        if (owner != 0 && (silent || !ProcessAlive(owner)) && Claim(slots[i], owner, pid, now)) {
+            slot = &slots[i];
+        }
+    }
+    if (!slot) {
+        std::cerr << "Endpoint registry " << path << " is full; not registering." << std::endl;
+        file.Close(file.Capacity());
+        return false;
+    }
+
+    // Clients only trust slots that say Ready, which SetStatus publishes after this.
+    slot->status = static_cast<uint32_t>(EndpointStatus::Starting);
+    slot->startedMillis = now;
+    slot->heartbeatMillis = now;
+    slot->connections = 0;
+    slot->queued = 0;
+    slot->served = 0;
+    memset(slot->endpoint, 0, sizeof(slot->endpoint));
+    memcpy(slot->endpoint, endpoint.data(), endpoint.size());
+    return true;
+}
+
+bool EndpointRegistry::Claim(RegistrySlot& candidate, uint32_t owner, uint32_t pid, uint64_t now) {
+    // Fails if another server got there first.
+    if (!candidate.pid.compare_exchange_strong(owner, pid)) {
+        return false;
+    }
+    // A reclaimed slot may still say Ready with the old endpoint; withdraw it first, and keep
+    // other registering servers from judging the slot stale before it is filled in.
+    candidate.status = static_cast<uint32_t>(EndpointStatus::Starting);
+    candidate.heartbeatMillis = now;
+    return true;
+}
+
+void EndpointRegistry::SetStatus(EndpointStatus status) {
+    if (slot) {
+        slot->heartbeatMillis = WallClockMillis();
+        slot->status = static_cast<uint32_t>(status);
+    }
+}
+
+void EndpointRegistry::Publish(uint32_t connections, uint32_t queued, uint64_t served) {
+    if (slot) {
+        slot->connections = connections;
+        slot->queued = queued;
+        slot->served = served;
+        slot->heartbeatMillis = WallClockMillis();
+    }
+}
+
+void EndpointRegistry::Unregister() {
+    if (!slot) {
+        return;
+    }
+    slot->status = static_cast<uint32_t>(EndpointStatus::Free);
+    memset(slot->endpoint, 0, sizeof(slot->endpoint));
+    slot->pid = 0;
+    slot = nullptr;
+    file.Close(file.Capacity());
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "pch.h"
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include "MappedFile.hpp"
+
+// Lets a controller find every server on the machine. Each server process claims a slot in
+// a small file mapped by all of them (JSHELL_REGISTRY, default <temp>/jshell-registry)
+// and keeps its endpoint, status and load current there; discover() in asyncremoteapi.py
+// reads it. All fields are little-endian:
+//
+//   RegistryHeader, then SlotCount RegistrySlots
+//
+// A slot belongs to the process in `pid`, 0 when free. Slots of processes that have exited
+// or stopped sending heartbeats are taken over by the next server to register.
+enum class EndpointStatus : uint32_t {
+    Free = 0,
+    Starting = 1, // slot claimed, endpoint not accepting yet
+    Ready = 2,
+    Stopping = 3
+};
+
+struct RegistryHeader {
+    char magic[4]; // "JSRG"
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t slotSize;
+};
+
+struct RegistrySlot {
+    std::atomic<uint32_t> pid;
+    std::atomic<uint32_t> status;           // EndpointStatus
+    uint64_t startedMillis;                 // Unix epoch milliseconds
+    std::atomic<uint64_t> heartbeatMillis;  // Unix epoch milliseconds
+    std::atomic<uint32_t> connections;      // clients connected
+    std::atomic<uint32_t> queued;           // requests waiting for the evaluator
+    std::atomic<uint64_t> served;           // requests evaluated since start
+    char endpoint[216];                     // NUL-terminated
+};
+
+static_assert(sizeof(RegistryHeader) == 16, "RegistryHeader layout is shared with clients");
+static_assert(sizeof(RegistrySlot) == 256, "RegistrySlot layout is shared with clients");
+
+class EndpointRegistry {
+public:
+    static const uint32_t Version = 1;
+    static const uint32_t SlotCount = 64;
+    // How often servers publish their load, and how long a silent slot is trusted.
+    static const uint32_t HeartbeatMillis = 250;
+    static const uint32_t StaleMillis = 10000;
+
+    EndpointRegistry();
+    ~EndpointRegistry();
+
+    EndpointRegistry(const EndpointRegistry&) = delete;
+    void operator=(const EndpointRegistry&) = delete;
+
+    // Claims a slot for this process in the Starting state. Returns false if the registry
+    // cannot be opened or is full; the server still runs, it just cannot be discovered.
+    bool Register(const std::string& endpoint);
+    void SetStatus(EndpointStatus status);
+    // Refreshes the load figures and the heartbeat.
+    void Publish(uint32_t connections, uint32_t queued, uint64_t served);
+    void Unregister();
+
+    static std::string Path();
+
+private:
+    // Takes the slot from `owner` (0 if free).
+    bool Claim(RegistrySlot& candidate, uint32_t owner, uint32_t pid, uint64_t now);
+
+    MappedFile file;
+    RegistrySlot* slot; // ours while registered
+};
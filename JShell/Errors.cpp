@@ -0,0 +1,80 @@
+#include "pch.h"
+#include "Errors.hpp"
+#include <sstream>
+
+namespace {
+    const char ErrorPrefix[] = "<ERROR>";
+    const char FieldSeparator = '\x1f';
+}
+
+std::string ErrorInfo::Format() const {
+    std::string out = ErrorPrefix;
+    out += std::to_string(static_cast<uint32_t>(code));
+    out += FieldSeparator;
+    out += Name(code);
+    out += FieldSeparator;
+    out += exceptionClass;
+    out += FieldSeparator;
+    out += message;
+    out += FieldSeparator;
+    out += stack;
+    return out;
+}
+
+const char* ErrorInfo::Name(ErrorCode code) {
+    switch (code) {
+    case ErrorCode::None:
+        return "none";
+    case ErrorCode::JavaException:
+        return "java_exception";
+    case ErrorCode::SnippetException:
+        return "snippet_exception";
+    case ErrorCode::SnippetRejected:
+        return "snippet_rejected";
+    case ErrorCode::NoShell:
+        return "no_shell";
+    case ErrorCode::NoClient:
+        return "no_client";
+    case ErrorCode::NoCanvas:
+        return "no_canvas";
+    case ErrorCode::JniFailure:
+        return "jni_failure";
+    case ErrorCode::HandleError:
+        return "handle_error";
+    case ErrorCode::Internal:
+        return "internal";
+    case ErrorCode::BadRequest:
+        return "bad_request";
+    }
+    return "unknown";
+}
+
+bool ErrorInfo::IsError(const std::string& response) {
+    return response.compare(0, sizeof(ErrorPrefix) - 1, ErrorPrefix) == 0;
+}
+
+ErrorStats::ErrorStats() {
+    for (size_t i = 0; i < ErrorCodeCount; i++) {
+        counts[i] = 0;
+    }
+}
+
+void ErrorStats::Record(ErrorCode code) {
+    size_t index = static_cast<size_t>(code);
+    if (index < ErrorCodeCount) {
+        counts[index]++;
+    }
+}
+
+std::string ErrorStats::Format() const {
+    unsigned long long total = 0;
+    std::ostringstream codes;
+    for (size_t i = 1; i < ErrorCodeCount; i++) {
+        total += counts[i];
+        codes << " " << ErrorInfo::Name(static_cast<ErrorCode>(i)) << "=" << counts[i];
+    }
+
+    std::ostringstream out;
+    out << "errors total=" << total << codes.str() << "\n";
+    return out.str();
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "pch.h"
+#include <string>
+#include <atomic>
+#include <cstdint>
+
+// Why an instruction failed. Sent as a number so clients can branch on it; the names are
+// for stats and logs.
+enum class ErrorCode : uint32_t {
+    None = 0,
+    JavaException = 1,    // a JNI call into Java threw
+    SnippetException = 2, // the snippet compiled, ran and threw
+    SnippetRejected = 3,  // the snippet did not compile
+    NoShell = 4,          // ShellPanel or its JShell is unavailable
+    NoClient = 5,         // the RuneLite client could not be reached
+    NoCanvas = 6,
+    JniFailure = 7,       // a JNI lookup or call returned nothing
+    HandleError = 8,      // unknown, released or over-limit handle
+    Internal = 9,         // the server failed, e.g. it is shutting down
+    BadRequest = 10       // the request itself is malformed, e.g. an unknown priority
+};
+
+const size_t ErrorCodeCount = 11;
+
+// A failed instruction. The response carries it in place of the value as
+//
+//   <ERROR>code US name US exception class US message US stack trace
+//
+// where US is the ASCII unit separator (0x1F); the class and stack may be empty. On the
+// framed protocol the frame also has FrameFlagError set, so clients need not look for the
+// prefix.
+struct ErrorInfo {
+    ErrorCode code = ErrorCode::None;
+    std::string exceptionClass;
+    std::string message;
+    std::string stack;
+
+    ErrorInfo() = default;
+    ErrorInfo(ErrorCode code, const std::string& message, const std::string& exceptionClass = std::string())
+        : code(code), exceptionClass(exceptionClass), message(message) {
+    }
+
+    bool Failed() const { return code != ErrorCode::None; }
+    std::string Format() const;
+
+    static const char* Name(ErrorCode code);
+    static bool IsError(const std::string& response);
+};
+
+// Failure counts per code, written by the evaluator thread and read by stats.
+struct ErrorStats {
+    std::atomic<unsigned long long> counts[ErrorCodeCount];
+
+    ErrorStats();
+    void Record(ErrorCode code);
+    std::string Format() const;
+};
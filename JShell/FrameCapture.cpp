@@ -0,0 +1,260 @@
+#include "pch.h"
+#include "FrameCapture.hpp"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <sstream>
+#include <iostream>
+
+namespace {
+    const char Magic[4] = { 'J', 'S', 'F', 'C' };
+
+    // Bounding box of the pixels that differ between two frames of the same size; false if
+    // none do. Unchanged rows are skipped with memcmp, which is most of a game frame.
+    bool ChangedArea(const uint32_t* before, const uint32_t* after, int width, int height, AWTRectangle& area) {
+        int top = -1;
+        int bottom = -1;
+        int left = width;
+        int right = -1;
+        for (int y = 0; y < height; y++) {
+            const uint32_t* a = before + static_cast<size_t>(y) * width;
+            const uint32_t* b = after + static_cast<size_t>(y) * width;
+            if (memcmp(a, b, width * sizeof(uint32_t)) == 0) {
+                continue;
+            }
+            if (top < 0) {
+                top = y;
+            }
+            bottom = y;
+            for (int x = 0; x < left; x++) {
+                if (a[x] != b[x]) {
+                    left = x;
+                    break;
+                }
+            }
+            for (int x = width - 1; x > right; x--) {
+                if (a[x] != b[x]) {
+                    right = x;
+                    break;
+                }
+            }
+        }
+        if (top < 0) {
+            return false;
+        }
+        area.x = left;
+        area.y = top;
+        area.width = right - left + 1;
+        area.height = bottom - top + 1;
+        return true;
+    }
+}
+
+FrameCapture::FrameCapture()
+    : capturing(false), region(), header(nullptr),
+      published(0), unchanged(0), failed(0), totalMicros(0), maxMicros(0) {
+}
+
+FrameCapture::~FrameCapture() {
+    Stop();
+}
+
+bool FrameCapture::Start(const std::string& path, const AWTRectangle& region) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (capturing) {
+        return false;
+    }
+    this->path = path;
+    this->region = region;
+    published = 0;
+    unchanged = 0;
+    failed = 0;
+    totalMicros = 0;
+    maxMicros = 0;
+
+    opened = std::promise<bool>();
+    std::future<bool> ready = opened.get_future();
+    capturing = true;
+    if (!StartThread(Run, this, &thread)) {
+        capturing = false;
+        return false;
+    }
+    if (!ready.get()) {
+        capturing = false;
+        JoinThread(thread);
+        return false;
+    }
+    return true;
+}
+
+void FrameCapture::Stop() {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!capturing) {
+        return;
+    }
+    capturing = false;
+    JoinThread(thread);
+    // The file keeps the last frame for readers that are still looking.
+    file.Close(file.Capacity());
+    header = nullptr;
+}
+
+ThreadResult THREADCALL FrameCapture::Run(void* lpParam) {
+    FrameCapture* capture = static_cast<FrameCapture*>(lpParam);
+    // JavaAPI attaches the constructing thread to the JVM, so it must live on this thread.
+    JavaAPI javaAPI;
+    bool ok = capture->Open(javaAPI);
+    capture->opened.set_value(ok);
+
+    while (ok && capture->capturing) {
+        auto start = std::chrono::steady_clock::now();
+        capture->Capture(javaAPI);
+        long long elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        if (elapsed < IntervalMillis) {
+            SleepMillis(static_cast<uint32_t>(IntervalMillis - elapsed));
+        }
+    }
+    return 0;
+}
+
+bool FrameCapture::Open(JavaAPI& javaAPI) {
+    AWTRectangle captured = {};
+    int frameWidth = 0;
+    int frameHeight = 0;
+    if (!javaAPI.ReadFrame(region, INT_MAX, INT_MAX, nullptr, captured, frameWidth, frameHeight)) {
+        std::cerr << "No frame to capture." << std::endl;
+        return false;
+    }
+
+    uint64_t pixelBytes = static_cast<uint64_t>(captured.width) * captured.height * sizeof(uint32_t);
+    uint32_t bufferSize = static_cast<uint32_t>((sizeof(FrameBufferHeader) + pixelBytes + 63) / 64 * 64);
+    // Opened in place rather than truncated: readers of a previous capture may still have
+    // the file mapped, and shrinking it under them would fault their next read (or, on
+    // Windows, fail the open). The file only ever grows.
+    if (!file.Open(path, sizeof(FrameFileHeader) + static_cast<uint64_t>(BufferCount) * bufferSize, true)) {
+        std::cerr << "Failed to open capture file " << path << ". Error Code: " << LastErrorCode() << std::endl;
+        return false;
+    }
+
+    // A reused file still holds the previous capture. Readers see the magic cleared and no
+    // frames published until the new layout is in place, and the magic goes in last.
+    header = reinterpret_cast<FrameFileHeader*>(file.Data());
+    memset(header->magic, 0, sizeof(header->magic));
+    header->published = 0;
+    header->front = 0;
+    header->version = Version;
+    header->bufferCount = BufferCount;
+    header->bufferSize = bufferSize;
+    header->maxWidth = static_cast<uint32_t>(captured.width);
+    header->maxHeight = static_cast<uint32_t>(captured.height);
+    header->intervalMillis = IntervalMillis;
+    for (uint32_t i = 0; i < BufferCount; i++) {
+        Buffer(i)->sequence = 0;
+    }
+    memcpy(header->magic, Magic, sizeof(Magic));
+    return true;
+}
+
+FrameBufferHeader* FrameCapture::Buffer(uint32_t index) const {
+    return reinterpret_cast<FrameBufferHeader*>(file.Data() + sizeof(FrameFileHeader) + static_cast<uint64_t>(index) * header->bufferSize);
+}
+
+void FrameCapture::Capture(JavaAPI& javaAPI) {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t count = header->published;
+    uint32_t front = header->front;
+    uint32_t back = count == 0 ? front : (front + 1) % BufferCount;
+    FrameBufferHeader* buffer = Buffer(back);
+    uint32_t* pixels = reinterpret_cast<uint32_t*>(buffer + 1);
+
+    // Readers only look at the front buffer, but one that picked it before the last flip
+    // may still be copying this one.
+    uint64_t sequence = buffer->sequence;
+    buffer->sequence = sequence + 1;
+
+    AWTRectangle captured = {};
+    int frameWidth = 0;
+    int frameHeight = 0;
+    bool ok = javaAPI.ReadFrame(region, static_cast<int>(header->maxWidth), static_cast<int>(header->maxHeight),
+        pixels, captured, frameWidth, frameHeight);
+    AWTRectangle changed = { 0, 0, captured.width, captured.height };
+    bool publish = ok;
+    if (ok && count > 0) {
+        const FrameBufferHeader* previous = Buffer(front);
+        if (previous->x == static_cast<uint32_t>(captured.x) && previous->y == static_cast<uint32_t>(captured.y)
+            && previous->width == static_cast<uint32_t>(captured.width) && previous->height == static_cast<uint32_t>(captured.height)) {
+            publish = ChangedArea(reinterpret_cast<const uint32_t*>(previous + 1), pixels, captured.width, captured.height, changed);
+        }
+    }
+
+    if (publish) {
+        buffer->frame = count + 1;
+        buffer->capturedMicros = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+        buffer->tick = javaAPI.TickCount();
+        buffer->frameWidth = static_cast<uint32_t>(frameWidth);
+        buffer->frameHeight = static_cast<uint32_t>(frameHeight);
+        buffer->x = static_cast<uint32_t>(captured.x);
+        buffer->y = static_cast<uint32_t>(captured.y);
+        buffer->width = static_cast<uint32_t>(captured.width);
+        buffer->height = static_cast<uint32_t>(captured.height);
+        buffer->changedX = static_cast<uint32_t>(changed.x);
+        buffer->changedY = static_cast<uint32_t>(changed.y);
+        buffer->changedWidth = static_cast<uint32_t>(changed.width);
+        buffer->changedHeight = static_cast<uint32_t>(changed.height);
+    }
+    buffer->sequence = sequence + 2;
+
+    if (!ok) {
+        failed++;
+        return;
+    }
+    if (publish) {
+        header->front = back;
+        header->published = count + 1;
+        published++;
+    }
+    else {
+        unchanged++;
+    }
+    unsigned long long micros = static_cast<unsigned long long>(
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+    totalMicros += micros;
+    if (micros > maxMicros) {
+        maxMicros = micros;
+    }
+}
+
+std::string FrameCapture::Stats() {
+    std::lock_guard<std::mutex> lock(mtx);
+    unsigned long long captures = published + unchanged;
+    std::ostringstream out;
+    out << "capture active=" << (capturing ? 1 : 0)
+        << " published=" << published
+        << " unchanged=" << unchanged
+        << " failed=" << failed
+        << " width=" << (header ? header->maxWidth : 0)
+        << " height=" << (header ? header->maxHeight : 0)
+        << " capture_avg_us=" << (captures ? totalMicros / captures : 0)
+        << " capture_max_us=" << maxMicros
+        << "\n";
+    return out.str();
+}
+
+bool FrameCapture::ParseArguments(const std::string& arguments, std::string& path, AWTRectangle& region) {
+    region = AWTRectangle();
+    AWTRectangle parsed = {};
+    std::string rest;
+    std::istringstream in(arguments);
+    if (in >> parsed.x >> parsed.y >> parsed.width >> parsed.height && std::getline(in >> std::ws, rest) && !rest.empty()) {
+        if (parsed.width <= 0 || parsed.height <= 0) {
+            return false;
+        }
+        region = parsed;
+        path = rest;
+        return true;
+    }
+    path = arguments;
+    return !path.empty();
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include "pch.h"
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <future>
+#include <cstdint>
+#include "JavaAPI.hpp"
+#include "MappedFile.hpp"
+#include "Platform.hpp"
+
+// Layout of a frame capture file, which consumers map read-only to pick up frames without
+// going through the pipe. All fields are little-endian:
+//
+//   FrameFileHeader, then bufferCount buffers of bufferSize bytes, each a FrameBufferHeader
+//   followed by width * height pixels (uint32 0x00RRGGBB, rows top to bottom)
+//
+// The writer fills the buffer that is not `front` and then flips `front`. A buffer's
+// sequence is odd while it is written; a reader copies a frame between two equal, even
+// reads of it. Restarting a capture on the same path reuses the file in place: `published`
+// drops back to 0 and the layout may change, so readers reload it when that happens.
+// framecapture.py reads the same layout.
+struct FrameFileHeader {
+    char magic[4];                   // "JSFC"
+    uint32_t version;
+    uint32_t bufferCount;
+    uint32_t bufferSize;             // bytes, header included
+    uint32_t maxWidth;               // largest region a buffer holds
+    uint32_t maxHeight;
+    std::atomic<uint32_t> front;     // buffer with the latest frame
+    uint32_t intervalMillis;         // how often the writer looks for a new frame
+    std::atomic<uint64_t> published; // frames published; 0 until the first one
+    uint8_t reserved[24];
+};
+
+struct FrameBufferHeader {
+    std::atomic<uint64_t> sequence;
+    uint64_t frame;                  // `published` when this frame went out
+    uint64_t capturedMicros;         // Unix epoch microseconds
+    int32_t tick;                    // client tick counter, -1 if unknown
+    uint32_t frameWidth;             // the whole frame the region was taken from
+    uint32_t frameHeight;
+    uint32_t x, y, width, height;    // region of the frame held by this buffer
+    // Bounding box of the pixels that differ from the previous frame, relative to the region.
+    uint32_t changedX, changedY, changedWidth, changedHeight;
+    uint8_t reserved[28];
+};
+
+static_assert(sizeof(FrameFileHeader) == 64, "FrameFileHeader layout is shared with readers");
+static_assert(sizeof(FrameBufferHeader) == 96, "FrameBufferHeader layout is shared with readers");
+
+// Copies the client's frame into a capture file at game rate. Started and stopped with the
+// "capture start" / "capture stop" commands; the capture thread has its own JavaAPI, so it
+// never waits for the evaluator. Frames identical to the previous one are not published.
+class FrameCapture {
+public:
+    static const uint32_t Version = 1;
+    static const uint32_t BufferCount = 2;
+    // RuneLite draws at most 50 frames a second by default.
+    static const uint32_t IntervalMillis = 20;
+
+    FrameCapture();
+    ~FrameCapture();
+
+    FrameCapture(const FrameCapture&) = delete;
+    void operator=(const FrameCapture&) = delete;
+
+    // Captures `region` of the frame (all of it if empty) into the file at `path`. Frames
+    // are cropped to the size of the first one; restart the capture to follow a larger one.
+    bool Start(const std::string& path, const AWTRectangle& region);
+    void Stop();
+    bool IsCapturing() const { return capturing; }
+    std::string Stats();
+
+    // Parses "[<x> <y> <width> <height>] <path>", the arguments of "capture start".
+    static bool ParseArguments(const std::string& arguments, std::string& path, AWTRectangle& region);
+    static ThreadResult THREADCALL Run(void* lpParam);
+
+private:
+    // Capture thread: maps the file once the first frame shows its size.
+    bool Open(JavaAPI& javaAPI);
+    void Capture(JavaAPI& javaAPI);
+    FrameBufferHeader* Buffer(uint32_t index) const;
+
+    std::mutex mtx; // serializes Start and Stop
+    std::atomic<bool> capturing;
+    ThreadHandle thread; // valid while capturing
+    std::promise<bool> opened;
+    std::string path;
+    AWTRectangle region;
+    MappedFile file;
+    FrameFileHeader* header;
+
+    std::atomic<unsigned long long> published;
+    std::atomic<unsigned long long> unchanged;
+    std::atomic<unsigned long long> failed;
+    std::atomic<unsigned long long> totalMicros;
+    std::atomic<unsigned long long> maxMicros;
+};
@@ -0,0 +1,162 @@
+#include "pch.h"
+#include "HandleTable.hpp"
+
+HandleTable::HandleTable(uint32_t sessionLimit)
+    : sessionLimit(sessionLimit), liveCount(0) {
+}
+
+bool HandleTable::Allocate(uint32_t session, uint32_t& slot, std::string& error) {
+    if (SessionSlots(session).size() >= sessionLimit) {
+        error = "Handle limit of " + std::to_string(sessionLimit) + " reached for this session";
+        return false;
+    }
+
+    if (!freeSlots.empty()) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    }
+    else if (slots.size() < MaxSlots) {
+        slot = static_cast<uint32_t>(slots.size());
+        slots.push_back(Slot());
+    }
+    else {
+        error = "Handle table is full";
+        return false;
+    }
+
+    slots[slot].used = true;
+    slots[slot].session = session;
+    slots[slot].snippet = nullptr;
+    liveCount++;
+    return true;
+}
+
+void HandleTable::Bind(uint32_t slot, jobject snippet) {
+    slots[slot].snippet = snippet;
+}
+
+jobject HandleTable::Release(uint32_t slot) {
+    Slot& entry = slots[slot];
+    if (!entry.used) {
+        return nullptr;
+    }
+
+    jobject snippet = entry.snippet;
+    entry.snippet = nullptr;
+    entry.used = false;
+    entry.generation++;
+    if (entry.generation == 0) {
+        entry.generation = 1; // 0 is never a valid generation, so id 0 never resolves
+    }
+    freeSlots.push_back(slot);
+    liveCount--;
+    return snippet;
+}
+
+bool HandleTable::Resolve(uint32_t id, uint32_t session, uint32_t& slot) const {
+    slot = id & 0xFFFF;
+    uint16_t generation = static_cast<uint16_t>(id >> 16);
+    if (slot >= slots.size()) {
+        return false;
+    }
+
+    const Slot& entry = slots[slot];
+    return entry.used && entry.generation == generation && entry.session == session;
+}
+
+std::vector<uint32_t> HandleTable::SessionSlots(uint32_t session) const {
+    std::vector<uint32_t> result;
+    for (uint32_t i = 0; i < slots.size(); i++) {
+        if (slots[i].used && slots[i].session == session) {
+            result.push_back(i);
+        }
+    }
+    return result;
+}
+
+std::vector<uint32_t> HandleTable::LiveSlots() const {
+    std::vector<uint32_t> result;
+    for (uint32_t i = 0; i < slots.size(); i++) {
+        if (slots[i].used) {
+            result.push_back(i);
+        }
+    }
+    return result;
+}
+
+uint32_t HandleTable::Id(uint32_t slot) const {
+    return (static_cast<uint32_t>(slots[slot].generation) << 16) | slot;
+}
+
+bool HandleTable::ParseId(const std::string& digits, uint32_t& id) {
+    if (digits.empty() || digits.size() > 10) {
+        return false;
+    }
+    uint64_t value = 0;
+    for (char c : digits) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        value = value * 10 + static_cast<uint64_t>(c - '0');
+    }
+    if (value > UINT32_MAX) {
+        return false;
+    }
+    id = static_cast<uint32_t>(value);
+    return true;
+}
+
+bool HandleTable::RewriteReferences(std::string& instruction, uint32_t session, std::string& error) const {
+    const std::string open = "$h{";
+    size_t pos = 0;
+    while (pos < instruction.size()) {
+        char c = instruction[pos];
+        // String and char literals and comments are left as written.
+        if (c == '"' || c == '\'') {
+            pos++;
+            while (pos < instruction.size() && instruction[pos] != c) {
+                pos += instruction[pos] == '\\' ? 2 : 1;
+            }
+            pos++;
+            continue;
+        }
+        if (instruction.compare(pos, 2, "//") == 0) {
+            pos = instruction.find('\n', pos);
+            continue;
+        }
+        if (instruction.compare(pos, 2, "/*") == 0) {
+            pos = instruction.find("*/", pos + 2);
+            pos = pos == std::string::npos ? pos : pos + 2;
+            continue;
+        }
+        if (instruction.compare(pos, open.size(), open) != 0) {
+            pos++;
+            continue;
+        }
+
+        size_t close = instruction.find('}', pos + open.size());
+        if (close == std::string::npos) {
+            break;
+        }
+        uint32_t id = 0;
+        uint32_t slot = 0;
+        if (!ParseId(instruction.substr(pos + open.size(), close - pos - open.size()), id)
+            || !Resolve(id, session, slot)) {
+            error = "Invalid or released handle " + instruction.substr(pos, close - pos + 1);
+            return false;
+        }
+
+        std::string name = VariableName(slot);
+        instruction.replace(pos, close - pos + 1, name);
+        pos += name.size();
+    }
+    return true;
+}
+
+std::string HandleTable::VariableName(uint32_t slot) {
+    return "$h" + std::to_string(slot);
+}
+
+std::string HandleTable::Token(uint32_t id) {
+    return "$h{" + std::to_string(id) + "}";
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "pch.h"
+#include <jni.h>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <atomic>
+
+// Bookkeeping for remote object handles.
+//
+// A handle keeps the result of a query alive between snippets: the object is held by a
+// JShell variable "$h<slot>" whose VarSnippet is pinned here through a JNI global ref, and
+// the client refers to it as "$h{<id>}". The id packs the slot with a generation counter
+// that is bumped on release, so a stale id never resolves to a slot that has been reused.
+// Only the evaluator thread touches the table; LiveCount() may be read from anywhere.
+class HandleTable {
+public:
+    static const uint32_t DefaultSessionLimit = 256;
+    static const uint32_t MaxSlots = 4096;
+
+    HandleTable(uint32_t sessionLimit = DefaultSessionLimit);
+
+    // Reserves a slot for the session, or fails with a message when a limit is hit.
+    bool Allocate(uint32_t session, uint32_t& slot, std::string& error);
+    void Bind(uint32_t slot, jobject snippet);
+    // Frees the slot and hands back the pinned snippet for the caller to drop.
+    jobject Release(uint32_t slot);
+    bool Resolve(uint32_t id, uint32_t session, uint32_t& slot) const;
+    std::vector<uint32_t> SessionSlots(uint32_t session) const;
+    std::vector<uint32_t> LiveSlots() const;
+
+    uint32_t Id(uint32_t slot) const;
+    size_t LiveCount() const { return liveCount; }
+
+    // Replaces every "$h{<id>}" in the instruction with the variable it names; string and
+    // char literals and comments are left alone.
+    bool RewriteReferences(std::string& instruction, uint32_t session, std::string& error) const;
+
+    // Parses the decimal id of a "$h{<id>}" reference: digits only, no sign or whitespace.
+    static bool ParseId(const std::string& digits, uint32_t& id);
+    static std::string VariableName(uint32_t slot);
+    static std::string Token(uint32_t id);
+
+private:
+    struct Slot {
+        jobject snippet = nullptr;
+        uint32_t session = 0;
+        uint16_t generation = 1;
+        bool used = false;
+    };
+
+    std::vector<Slot> slots;
+    std::vector<uint32_t> freeSlots;
+    uint32_t sessionLimit;
+    std::atomic<size_t> liveCount;
+};
@@ -4,6 +4,7 @@
 #include <jni.h>
 #include <unordered_map>
 #include <string>
+#include <mutex>
 
 class JniCache {
 public:
@@ -15,6 +16,9 @@ public:
     JniCache(const JniCache&) = delete; // Prevent copy
     void operator=(const JniCache&) = delete; // Prevent assignment
 
+    // The evaluator and the frame capture thread each have a JavaAPI; both share this cache.
+    std::mutex mtx;
+
     // Cache for method IDs, using className::methodName as the key.
     std::unordered_map<std::string, jmethodID> methodCache;
     // Cache for class objects, using className as the key.
@@ -24,18 +28,68 @@ public:
 
     // Method to get a class object from the cache, or find and add it to the cache.
     jclass getClass(JNIEnv* env, const std::string& name, jobject object) {
+        std::lock_guard<std::mutex> lock(mtx);
         auto it = classCache.find(name);
         if (it != classCache.end()) {
             return it->second;
         }
 
-        jclass cls = env->GetObjectClass(object);
+        // Cached entries outlive the local frame they were found in, so hold them globally.
+        jclass local = env->GetObjectClass(object);
+        jclass cls = (jclass)env->NewGlobalRef(local);
+        env->DeleteLocalRef(local);
         classCache[name] = cls;
         return cls;
     }
 
+    // Method to get a class by name from the cache, or look it up and add it to the cache.
+    // Use this for interfaces and base classes whose instances come in many concrete types.
+    jclass findClass(JNIEnv* env, const std::string& name) {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = classCache.find(name);
+        if (it != classCache.end()) {
+            return it->second;
+        }
+
+        jclass local = env->FindClass(name.c_str());
+        if (env->ExceptionCheck()) {
+            env->ExceptionClear();
+            return nullptr;
+        }
+
+        jclass cls = (jclass)env->NewGlobalRef(local);
+        env->DeleteLocalRef(local);
+        classCache[name] = cls;
+        return cls;
+    }
+
+    // Method to get the injector's instance of a class from the cache, or look it up and add
+    // it to the cache. Only for singletons such as ClientThread.
+    jobject getInjected(JNIEnv* env, const std::string& key, jobject injector, jclass clazz) {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = objectCache.find(key);
+        if (it != objectCache.end()) {
+            return it->second;
+        }
+
+        jclass injectorClass = env->GetObjectClass(injector);
+        jmethodID getInstance = env->GetMethodID(injectorClass, "getInstance", "(Ljava/lang/Class;)Ljava/lang/Object;");
+        env->DeleteLocalRef(injectorClass);
+        jobject local = getInstance ? env->CallObjectMethod(injector, getInstance, clazz) : nullptr;
+        if (env->ExceptionCheck() || local == nullptr) {
+            env->ExceptionClear();
+            return nullptr;
+        }
+
+        jobject object = env->NewGlobalRef(local);
+        env->DeleteLocalRef(local);
+        objectCache[key] = object;
+        return object;
+    }
+
     // Method to get a method ID from the cache, or find and add it to the cache.
     jmethodID getMethodID(JNIEnv* env, const std::string& key, jclass clazz, const char* name, const char* sig) {
+        std::lock_guard<std::mutex> lock(mtx);
         auto it = methodCache.find(key);
         if (it != methodCache.end()) {
             return it->second;
@@ -53,23 +107,27 @@ public:
 
     // Method to get a jobject from the cache, or find and add it to the cache.
     jobject getObject(JNIEnv* env, const std::string& key, jclass clazz, const char* name, const char* sig) {
+        std::lock_guard<std::mutex> lock(mtx);
 		auto it = objectCache.find(key);
         if (it != objectCache.end()) {
 			return it->second;
 		}
 
-		jobject object = env->GetStaticObjectField(clazz, env->GetStaticFieldID(clazz, name, sig));
+		jobject local = env->GetStaticObjectField(clazz, env->GetStaticFieldID(clazz, name, sig));
         if (env->ExceptionCheck()) {
 			env->ExceptionClear();
 			return nullptr;
 		}
 
+		jobject object = env->NewGlobalRef(local);
+		env->DeleteLocalRef(local);
 		objectCache[key] = object;
 		return object;
 	}
 
     // Method to get a jfieldID from the cache, or find and add it to the cache.
     jfieldID getFieldID(JNIEnv* env, const std::string& key, jclass clazz, const char* name, const char* sig) {
+        std::lock_guard<std::mutex> lock(mtx);
 		auto it = fieldCache.find(key);
         if (it != fieldCache.end()) {
 			return it->second;
@@ -87,8 +145,8 @@ public:
 
     // Destructor for cleanup.
     ~JniCache() {
-        // Handle the cleanup, if needed.
-        // Remember to delete global references, if any.
+        // Class and object entries are global references. They are intentionally not
+        // deleted here: this runs at process exit, when no JNIEnv may be attached.
     }
 
 private:
@@ -1,33 +1,34 @@
 #include "pch.h"
 #include "JavaAPI.hpp"
-
-void DisplayErrorMessage(const std::wstring& message) {
-    MessageBoxW(NULL, message.c_str(), L"Error", MB_OK | MB_ICONERROR);
+#include "Platform.hpp"
+#include <cctype>
+#include <chrono>
+#include <iostream>
+
+namespace {
+    // Calls a String-returning method; an exception from the call is cleared and yields null.
+    jstring CallStringMethod(JNIEnv* env, jobject object, jmethodID method) {
+        jstring value = (jstring)env->CallObjectMethod(object, method);
+        if (env->ExceptionCheck()) {
+            env->ExceptionClear();
+            return nullptr;
+        }
+        return value;
+    }
 }
 
-void checkAndClearException(JNIEnv* env) {
-    // Check if an exception occurred
-    if (env->ExceptionCheck()) {
-        // Get the exception object
-        jthrowable exception = env->ExceptionOccurred();
-
-        // Clear the exception to be able to call further JNI methods
-        env->ExceptionClear();
-
-        // Retrieve the toString() representation of the exception
-        jclass throwableClass = env->FindClass("java/lang/Throwable");
-        jmethodID toStringMethod = env->GetMethodID(throwableClass, "toString", "()Ljava/lang/String;");
-        jstring exceptionString = (jstring)env->CallObjectMethod(exception, toStringMethod);
-        const char* exceptionCString = env->GetStringUTFChars(exceptionString, JNI_FALSE);
-
-        // Display the exception message
-        std::wstring message = L"JNI Exception: " + std::wstring(exceptionCString, exceptionCString + strlen(exceptionCString));
-        MessageBox(NULL, message.c_str(), L"JNI Exception", MB_OK | MB_ICONERROR);
-
-        // Clean up local references and release string memory
-        env->ReleaseStringUTFChars(exceptionString, exceptionCString);
-        env->DeleteLocalRef(exceptionString);
-        env->DeleteLocalRef(throwableClass);
+void SnippetStats::RecordEval(unsigned long long micros) {
+    evals++;
+    windowMicros += micros;
+    windowCount++;
+    if (windowCount == WindowSize) {
+        unsigned long long average = windowMicros / windowCount;
+        if (firstWindowMicros == 0) {
+            firstWindowMicros = average;
+        }
+        recentWindowMicros = average;
+        windowMicros = 0;
+        windowCount = 0;
     }
 }
 
@@ -35,88 +36,43 @@ JavaAPI::JavaAPI() : cache(JniCache::getInstance()) {
     jvm = nullptr;
     env = nullptr;
 
+#ifdef _WIN32
     GetComponent = nullptr;
+    clientHWND = nullptr;
+#endif
 
     injector = nullptr;
     client = nullptr;
     canvas = nullptr;
     shell = nullptr;
     eval = nullptr;
-    clientHWND = nullptr;
     jshellpanel = nullptr;
+    lastCompaction = 0;
+    tickUnavailable = false;
+    tickHelper = nullptr;
+    tickBatch = nullptr;
+    tickForget = nullptr;
+    nextTickRead = 0;
 
     jsize nVMs;
     jint ret = JNI_GetCreatedJavaVMs(&jvm, 1, &nVMs);
     if (ret != JNI_OK || nVMs == 0) {
-        DisplayErrorMessage(L"No JVM found");
+        DisplayErrorMessage("No JVM found");
         exit(1);
     }
     ret = jvm->AttachCurrentThread((void**)&env, NULL);
     if (ret != JNI_OK) {
-        DisplayErrorMessage(L"Failed to attach to JVM");
+        DisplayErrorMessage("Failed to attach to JVM");
         exit(1);
     }
 
 }
 
-static BOOL CALLBACK GetHWNDCurrentPID(HWND WindowHandle, LPARAM lParam)
-{
-    auto handles = reinterpret_cast<std::vector<HWND>*>(lParam);
-    DWORD currentPID = GetCurrentProcessId();
-    DWORD windowPID;
-    GetWindowThreadProcessId(WindowHandle, &windowPID);
-
-    if (currentPID == windowPID)
-    {
-        handles->push_back(WindowHandle);
-    }
-
-
-    return TRUE;
-}
-
-HWND JavaAPI::FindWindowWithClassName(const std::vector<HWND>& windows, const wchar_t* className)
-{
-    wchar_t nameBuffer[128];
-
-    for (auto window : windows)
-    {
-        GetClassNameW(window, nameBuffer, sizeof(nameBuffer) / sizeof(wchar_t));  // Using the Unicode version
-        if (wcscmp(nameBuffer, className) == 0)  // Wide string comparison
-            return window;
-    }
-    DisplayErrorMessage(L"Failed to find window with class name");
-    return nullptr;
-}
-
-HWND JavaAPI::FindWindowWithTitle(const std::vector<HWND>& windows, const wchar_t* windowTitle)
-{
-    wchar_t titleBuffer[256]; // Adjust the size as needed
-
-    for (auto window : windows)
-    {
-        GetWindowTextW(window, titleBuffer, sizeof(titleBuffer) / sizeof(wchar_t));  // Using the Unicode version
-        if (wcscmp(titleBuffer, windowTitle) == 0)  // Wide string comparison
-            return window;
-    }
-    return nullptr;
-}
-
-HWND JavaAPI::GetNestedCanvas(HWND parent, const wchar_t* className) {
-    HWND currentChild = GetWindow(parent, GW_CHILD);
-    while (currentChild) {
-        if (FindWindowWithClassName({ currentChild }, className)) {
-            HWND nestedChild = GetNestedCanvas(currentChild, className);
-            if (nestedChild) {
-                return nestedChild;
-            }
-        }
-        currentChild = GetWindow(currentChild, GW_HWNDNEXT);
-    }
-    return nullptr;
+JavaAPI::~JavaAPI() {
+    // The evaluator thread is ending; an attached thread would keep DestroyJavaVM waiting.
+    DetachThread(&env);
 }
 
-
 bool JavaAPI::AttachToThread(JNIEnv** Thread)
 {
     if (this->jvm)
@@ -134,333 +90,674 @@ bool JavaAPI::DetachThread(JNIEnv** Thread)
     return !(*Thread);
 }
 
-HWND JavaAPI::GetCanvasHWND() {
-    std::vector<HWND> matchedWindows;
-    EnumWindows(GetHWNDCurrentPID, reinterpret_cast<LPARAM>(&matchedWindows));
-
-    //HWND frameHandle = FindWindowWithClassName(matchedWindows, L"SunAwtFrame");
-    HWND frameHandle = FindWindowWithTitle(matchedWindows, L"RuneLite");
-
-    if (!frameHandle) {
-        DisplayErrorMessage(L"Failed to find frame");
-        return nullptr; // No parent frame found.
-    }
-    HWND canvasHandle = GetWindow(frameHandle, GW_CHILD);
-    if (!canvasHandle) {
-        DisplayErrorMessage(L"Failed to find canvas");
-        return nullptr;
-    }
-    clientHWND = frameHandle;
-    return canvasHandle;
-}
-
 jobject JavaAPI::getJShell() {
     // Get the ShellPanel class
     jclass shellPanelClass = env->FindClass("com/hydratech/jshell/ShellPanel");
-    if (!shellPanelClass) {
-        DisplayErrorMessage(L"Failed to find ShellPanel class");
+    if (!Require(shellPanelClass != nullptr, ErrorCode::NoShell, "Failed to find ShellPanel class")) {
         return nullptr;
     }
 
     // Get the shell field
     jfieldID shellFieldID = env->GetFieldID(shellPanelClass, "shell", "Ljdk/jshell/JShell;");
-    if (!shellFieldID) {
-        DisplayErrorMessage(L"Failed to find ShellPanel class");
+    if (!Require(shellFieldID != nullptr, ErrorCode::NoShell, "Failed to find ShellPanel.shell field")) {
         return nullptr;
     }
 
-    // 3. Call the setAccessible method on the Field object
-    // First, get the Field class and setAccessible method ID
-    jclass fieldClass = env->FindClass("java/lang/reflect/Field");
-    jmethodID setAccessibleMethod = env->GetMethodID(fieldClass, "setAccessible", "(Z)V");
-    if (!setAccessibleMethod) {
-        DisplayErrorMessage(L"Failed to find ShellPanel class");
-        return nullptr;
-    } // method not found
-
-
     // Get the INSTANCE of ShellPanel
     jfieldID instanceFieldID = env->GetStaticFieldID(shellPanelClass, "INSTANCE", "Lcom/hydratech/jshell/ShellPanel;");
-    if (!instanceFieldID) {
-        DisplayErrorMessage(L"Failed to find ShellPanel class");
+    if (!Require(instanceFieldID != nullptr, ErrorCode::NoShell, "Failed to find ShellPanel.INSTANCE field")) {
         return nullptr;
     }
 
-    jshellpanel = env->GetStaticObjectField(shellPanelClass, instanceFieldID);
-    if (!jshellpanel) {
-        DisplayErrorMessage(L"Failed to find ShellPanel class");
+    jobject panel = env->GetStaticObjectField(shellPanelClass, instanceFieldID);
+    if (!Require(panel != nullptr, ErrorCode::NoShell, "ShellPanel.INSTANCE is not set")) {
         return nullptr;
     }
+    if (jshellpanel) {
+        env->DeleteGlobalRef(jshellpanel);
+    }
+    jshellpanel = env->NewGlobalRef(panel);
+    env->DeleteLocalRef(panel);
 
-    if (this->injector == nullptr)
+    if (this->injector == nullptr && !getClient())
     {
-        getClient();
+        return nullptr;
     }
     jmethodID switchContext = cache.getMethodID(env, "ShellPanelClass", shellPanelClass, "switchContext", "(Lcom/google/inject/Injector;)V");
-    if (!switchContext) {
-        DisplayErrorMessage(L"Failed to find ShellPanel class");
+    if (!Require(switchContext != nullptr, ErrorCode::NoShell, "Failed to find ShellPanel.switchContext")) {
         return nullptr;
     }
     env->CallVoidMethod(jshellpanel, switchContext, this->injector);
-    checkAndClearException(env);
+    if (!Require(true, ErrorCode::NoShell, "ShellPanel.switchContext failed")) {
+        return nullptr;
+    }
 
-    // Get the JShell object
-    this->shell = env->GetObjectField(jshellpanel, shellFieldID);
-    checkAndClearException(env);
+    // Get the JShell object. It is held globally because instructions run in local frames.
+    jobject localShell = env->GetObjectField(jshellpanel, shellFieldID);
+    if (this->shell) {
+        env->DeleteGlobalRef(this->shell);
+    }
+    this->shell = localShell ? env->NewGlobalRef(localShell) : nullptr;
+    if (!Require(this->shell != nullptr, ErrorCode::NoShell, "ShellPanel has no shell")) {
+        return nullptr;
+    }
 
     jclass shellClass = env->GetObjectClass(shell);
     jmethodID eval = env->GetMethodID(shellClass, "eval", "(Ljava/lang/String;)Ljava/util/List;");
     this->eval = eval;
+    // A new shell has none of the old declarations.
+    ResetTickReads();
 
     return shell;
 }
 
 jobject JavaAPI::getClient() {
     jclass runeLiteClass = env->FindClass("net/runelite/client/RuneLite");
-    if (env->ExceptionCheck()) {
-        MessageBoxW(NULL, L"Failed to find RuneLite class", L"Error", MB_OK | MB_ICONERROR);
-        env->ExceptionClear();
-        return nullptr; // or handle the error as appropriate
+    if (!Require(runeLiteClass != nullptr, ErrorCode::NoClient, "Failed to find RuneLite class")) {
+        return nullptr;
     }
 
     jfieldID injectorField = env->GetStaticFieldID(runeLiteClass, "injector", "Lcom/google/inject/Injector;");
-    if (env->ExceptionCheck()) {
-        MessageBoxW(NULL, L"Failed to find injector field", L"Error", MB_OK | MB_ICONERROR);
-        env->ExceptionClear();
-        return nullptr; // or handle the error as appropriate
+    if (!Require(injectorField != nullptr, ErrorCode::NoClient, "Failed to find injector field")) {
+        return nullptr;
     }
 
     jobject injector = env->GetStaticObjectField(runeLiteClass, injectorField);
-    if (env->ExceptionCheck()) {
-        MessageBoxW(NULL, L"Failed to find injector object", L"Error", MB_OK | MB_ICONERROR);
-        env->ExceptionClear();
-        return nullptr; // or handle the error as appropriate
+    if (!Require(injector != nullptr, ErrorCode::NoClient, "Failed to find injector object")) {
+        return nullptr;
     }
-    this->injector = injector;
+    if (this->injector) {
+        env->DeleteGlobalRef(this->injector);
+    }
+    this->injector = env->NewGlobalRef(injector);
     jclass injectorClass = cache.getClass(env, "InjectorClass", injector);
-    if (env->ExceptionCheck()) {
-        MessageBoxW(NULL, L"Failed to find injector class", L"Error", MB_OK | MB_ICONERROR);
-        env->ExceptionClear();
-        return nullptr; // or handle the error as appropriate
+    if (!Require(injectorClass != nullptr, ErrorCode::NoClient, "Failed to find injector class")) {
+        return nullptr;
     }
 
     jmethodID getInstanceMethod = env->GetMethodID(injectorClass, "getInstance", "(Ljava/lang/Class;)Ljava/lang/Object;");
-    if (env->ExceptionCheck()) {
-        MessageBoxW(NULL, L"Failed to find injector instance", L"Error", MB_OK | MB_ICONERROR);
-        env->ExceptionClear();
-        return nullptr; // or handle the error as appropriate
+    if (!Require(getInstanceMethod != nullptr, ErrorCode::NoClient, "Failed to find injector instance")) {
+        return nullptr;
     }
 
     jobject runeLiteClient = env->CallObjectMethod(injector, getInstanceMethod, runeLiteClass);
-    if (env->ExceptionCheck()) {
-        MessageBoxW(NULL, L"Failed to call injector method", L"Error", MB_OK | MB_ICONERROR);
-        env->ExceptionClear();
-        return nullptr; // or handle the error as appropriate
+    if (!Require(runeLiteClient != nullptr, ErrorCode::NoClient, "Failed to call injector method")) {
+        return nullptr;
     }
     jclass runeLiteClientClass = env->GetObjectClass(runeLiteClient);
-    if (env->ExceptionCheck()) {
-        MessageBoxW(NULL, L"Failed to find client class", L"Error", MB_OK | MB_ICONERROR);
-        env->ExceptionClear();
-        return nullptr; // or handle the error as appropriate
-    }
 
     jfieldID clientField = env->GetFieldID(runeLiteClientClass, "client", "Lnet/runelite/api/Client;");
-    if (env->ExceptionCheck()) {
-        MessageBoxW(NULL, L"Failed to find client field", L"Error", MB_OK | MB_ICONERROR);
-        env->ExceptionClear();
-        return nullptr; // or handle the error as appropriate
+    if (!Require(clientField != nullptr, ErrorCode::NoClient, "Failed to find client field")) {
+        return nullptr;
     }
 
     jobject client = env->GetObjectField(runeLiteClient, clientField);
-    if (env->ExceptionCheck()) {
-        MessageBoxW(NULL, L"Failed to find client object field", L"Error", MB_OK | MB_ICONERROR);
-        env->ExceptionClear();
-        return nullptr; // or handle the error as appropriate
+    if (!Require(client != nullptr, ErrorCode::NoClient, "Failed to find client object field")) {
+        return nullptr;
     }
 
     jclass clientClass = cache.getClass(env, "ClientClass", client);
-    if (env->ExceptionCheck()) {
-        MessageBoxW(NULL, L"Failed to find client object class", L"Error", MB_OK | MB_ICONERROR);
-        env->ExceptionClear();
-        return nullptr; // or handle the error as appropriate
+    if (!Require(clientClass != nullptr, ErrorCode::NoClient, "Failed to find client object class")) {
+        return nullptr;
+    }
+    if (this->client) {
+        env->DeleteGlobalRef(this->client);
     }
-    checkAndClearException(env);
     this->client = env->NewGlobalRef(client);
     return client;
 }
 
-
-jobject JavaAPI::GrabCanvas() {
-    HMODULE jvmDLL = GetModuleHandle(L"jvm.dll");
-    if (!jvmDLL) {
-        MessageBoxW(NULL, L"get jvm.ll failure", L"", MB_OK | MB_ICONERROR);
-        return nullptr;
+bool JavaAPI::EnsureClient() {
+    if (!this->client) {
+        env->PushLocalFrame(16);
+        getClient();
+        env->PopLocalFrame(nullptr);
+        // Not having a client yet is not a failure of any instruction.
+        failure = ErrorInfo();
     }
+    return this->client != nullptr;
+}
 
-    ptr_GCJavaVMs getJVMs = (ptr_GCJavaVMs)GetProcAddress(jvmDLL, "JNI_GetCreatedJavaVMs");
-    if (!getJVMs) {
-        MessageBoxW(NULL, L"get jvm failure", L"", MB_OK | MB_ICONERROR);
-        return nullptr;
+bool JavaAPI::CheckException(ErrorCode code, const std::string& context) {
+    if (!env->ExceptionCheck()) {
+        return false;
     }
-    JNIEnv* thread = nullptr;
+    jthrowable exception = env->ExceptionOccurred();
+    env->ExceptionClear();
 
-    do {
-        getJVMs(&(this->jvm), 1, nullptr);
-        if (!this->jvm) {
-            MessageBoxW(NULL, L"get jvm failure2", L"", MB_OK | MB_ICONERROR);
-            break;
+    if (!failure.Failed()) {
+        failure = DescribeThrowable(exception, code);
+        if (!context.empty()) {
+            failure.message = failure.message.empty() ? context : context + ": " + failure.message;
         }
+    }
+    env->DeleteLocalRef(exception);
+    return true;
+}
 
-        this->AttachToThread(&env);
+void JavaAPI::DiscardException() {
+    if (!env->ExceptionCheck()) {
+        return;
+    }
+    jthrowable exception = env->ExceptionOccurred();
+    env->ExceptionClear();
 
-        HMODULE awtDLL = GetModuleHandle(L"awt.dll");
-        if (!awtDLL) {
-            MessageBoxW(NULL, L"get awt dll failure", L"", MB_OK | MB_ICONERROR);
-            break;
-        }
+    ErrorInfo info = DescribeThrowable(exception, ErrorCode::JavaException);
+    env->DeleteLocalRef(exception);
+    errorStats.Record(info.code);
+    std::cerr << "Ignored " << info.exceptionClass << ": " << info.message << std::endl;
+}
 
-        const char* awtFuncName = (sizeof(void*) == 8) ? "DSGetComponent" : "_DSGetComponent@8";
-        this->GetComponent = (ptr_GetComponent)GetProcAddress(awtDLL, awtFuncName);
-        if (!env || !this->GetComponent) {
-            MessageBoxW(NULL, L"get component failure", L"", MB_OK | MB_ICONERROR);
-            break;
-        }
+std::string JavaAPI::Fail(ErrorCode code, const std::string& message) {
+    if (!failure.Failed()) {
+        failure = ErrorInfo(code, message);
+    }
+    return std::string();
+}
 
-        HWND canvasHWND = GetCanvasHWND();
-        if (!canvasHWND) {
-            MessageBoxW(NULL, L"get handle failure", L"", MB_OK | MB_ICONERROR);
-            break;
-        }
-        jobject tempCanvas = this->GetComponent(env, (void*)canvasHWND);
-        if (!tempCanvas) {
-            MessageBoxW(NULL, L"get component failure", L"", MB_OK | MB_ICONERROR);
-            break;
-        }
+bool JavaAPI::Require(bool ok, ErrorCode code, const std::string& message) {
+    if (CheckException(code, message) || !ok) {
+        Fail(code, message);
+        return false;
+    }
+    return true;
+}
 
-        jclass canvasClass = env->GetObjectClass(tempCanvas);
-        if (!canvasClass) {
-            MessageBoxW(NULL, L"canvas object class failure", L"", MB_OK | MB_ICONERROR);
-            break;
-        }
+ErrorInfo JavaAPI::DescribeThrowable(jthrowable throwable, ErrorCode code) {
+    ErrorInfo info(code, "Unknown exception");
+    jclass throwableClass = cache.findClass(env, "java/lang/Throwable");
+    jclass classClass = cache.findClass(env, "java/lang/Class");
+    jclass elementClass = cache.findClass(env, "java/lang/StackTraceElement");
+    if (throwableClass == nullptr || classClass == nullptr || elementClass == nullptr) {
+        return info;
+    }
+    jmethodID getMessage = cache.getMethodID(env, "Throwable_getMessage", throwableClass, "getMessage", "()Ljava/lang/String;");
+    jmethodID getStackTrace = cache.getMethodID(env, "Throwable_getStackTrace", throwableClass, "getStackTrace", "()[Ljava/lang/StackTraceElement;");
+    jmethodID getName = cache.getMethodID(env, "Class_getName", classClass, "getName", "()Ljava/lang/String;");
+    jmethodID frameToString = cache.getMethodID(env, "StackTraceElement_toString", elementClass, "toString", "()Ljava/lang/String;");
+
+    // JShell rethrows a snippet's exception as an EvalException that only names the original class.
+    jclass evalExceptionClass = cache.findClass(env, "jdk/jshell/EvalException");
+    if (evalExceptionClass != nullptr && env->IsInstanceOf(throwable, evalExceptionClass)) {
+        jmethodID getExceptionClassName = cache.getMethodID(env, "EvalException_getExceptionClassName", evalExceptionClass, "getExceptionClassName", "()Ljava/lang/String;");
+        info.exceptionClass = ReadString(CallStringMethod(env, throwable, getExceptionClassName));
+    }
+    else {
+        jclass actualClass = env->GetObjectClass(throwable);
+        info.exceptionClass = ReadString(CallStringMethod(env, actualClass, getName));
+        env->DeleteLocalRef(actualClass);
+    }
+    info.message = ReadString(CallStringMethod(env, throwable, getMessage));
 
-        jmethodID canvas_getParent = env->GetMethodID(canvasClass, "getParent", "()Ljava/awt/Container;");
-        if (!canvas_getParent) {
-            MessageBoxW(NULL, L"get parent failure", L"", MB_OK | MB_ICONERROR);
-            break;
+    jobjectArray frames = (jobjectArray)env->CallObjectMethod(throwable, getStackTrace);
+    if (env->ExceptionCheck()) {
+        env->ExceptionClear();
+        frames = nullptr;
+    }
+    if (frames != nullptr) {
+        jsize count = env->GetArrayLength(frames);
+        for (jsize i = 0; i < count && i < MaxStackFrames; i++) {
+            jobject frame = env->GetObjectArrayElement(frames, i);
+            info.stack += "\tat " + ReadString(CallStringMethod(env, frame, frameToString)) + "\n";
+            env->DeleteLocalRef(frame);
         }
-
-        jobject tempClient = env->CallObjectMethod(tempCanvas, canvas_getParent);
-        if (tempClient) {
-            this->canvas = env->NewGlobalRef(tempClient);
-            env->DeleteLocalRef(tempClient);
-            return this->canvas;
+        if (count > MaxStackFrames) {
+            info.stack += "\t... " + std::to_string(count - MaxStackFrames) + " more\n";
         }
-        else {
-            MessageBoxW(NULL, L"get client failure", L"", MB_OK | MB_ICONERROR);
-            break;
+        env->DeleteLocalRef(frames);
+    }
+    return info;
+}
+
+std::string JavaAPI::RejectionMessage(jobject snippet) {
+    const std::string fallback = "Snippet rejected";
+    jclass shellClass = cache.getClass(env, "JShellClass", shell);
+    jclass streamClass = cache.findClass(env, "java/util/stream/Stream");
+    jclass diagClass = cache.findClass(env, "jdk/jshell/Diag");
+    if (streamClass == nullptr || diagClass == nullptr) {
+        return fallback;
+    }
+    jmethodID diagnostics = cache.getMethodID(env, "JShellDiagnostics", shellClass, "diagnostics", "(Ljdk/jshell/Snippet;)Ljava/util/stream/Stream;");
+    jmethodID toArray = cache.getMethodID(env, "Stream_toArray", streamClass, "toArray", "()[Ljava/lang/Object;");
+    jmethodID getMessage = cache.getMethodID(env, "Diag_getMessage", diagClass, "getMessage", "(Ljava/util/Locale;)Ljava/lang/String;");
+
+    // The compiler diagnostics, one per line.
+    jobject stream = env->CallObjectMethod(shell, diagnostics, snippet);
+    jobjectArray all = stream && !env->ExceptionCheck() ? (jobjectArray)env->CallObjectMethod(stream, toArray) : nullptr;
+    std::string message;
+    if (all != nullptr && !env->ExceptionCheck()) {
+        jsize count = env->GetArrayLength(all);
+        for (jsize i = 0; i < count; i++) {
+            jobject diag = env->GetObjectArrayElement(all, i);
+            jstring text = (jstring)env->CallObjectMethod(diag, getMessage, (jobject)nullptr);
+            if (env->ExceptionCheck()) {
+                env->ExceptionClear();
+                text = nullptr;
+            }
+            message += (message.empty() ? "" : "\n") + ReadString(text);
+            env->DeleteLocalRef(diag);
         }
-        checkAndClearException(env);
-        this->canvas = env->NewGlobalRef(tempClient);
-        return this->canvas;
-    } while (false);
-    return nullptr;
+    }
+    DiscardException();
+    return message.empty() ? fallback : message;
 }
 
-std::string JavaAPI::ProcessInstruction(const std::string& instruction) {
-    std::string result = "";
+std::string JavaAPI::ReadString(jstring string) {
+    if (string == nullptr) {
+        return std::string();
+    }
+    std::string result;
+    JniStrings::Append(env, string, result);
+    env->DeleteLocalRef(string);
+    return result;
+}
+
+
+std::string JavaAPI::ProcessInstruction(const std::string& request, uint32_t session) {
+    failure = ErrorInfo();
     if (!this->env) {
         GrabCanvas();
     }
     if (!this->shell) {
         getJShell();
     }
-    if (instruction == "cleanup") {
-		cleanup();
+
+    // This thread never returns to Java, so local references would otherwise pile up for
+    // the lifetime of the process. Everything kept across instructions is a global ref.
+    env->PushLocalFrame(64);
+    std::string result = Evaluate(request, session);
+    env->PopLocalFrame(nullptr);
+
+    // Failures are answered, never shown: a dialog would stall every client behind it.
+    if (failure.Failed()) {
+        errorStats.Record(failure.code);
+        result = failure.Format();
+    }
+
+    if (snippetStats.evals - lastCompaction >= CompactionInterval) {
+        lastCompaction = snippetStats.evals;
+        env->PushLocalFrame(64);
+        CompactSnippets();
+        env->PopLocalFrame(nullptr);
+    }
+    return result;
+}
+
+std::string JavaAPI::Evaluate(const std::string& request, uint32_t session) {
+    std::string result = "";
+    // Clients terminate everything with ';', commands included.
+    std::string command = request;
+    while (!command.empty() && (command.back() == ';' || isspace(static_cast<unsigned char>(command.back())))) {
+        command.pop_back();
+    }
+    if (command == "cleanup") {
+		RebuildShell();
 		return result;
 	}
-    if (this->shell) {
-        jstring jString = env->NewStringUTF(instruction.c_str());
-        jobject snippetList = env->CallObjectMethod(shell, eval, jString);
-        if (snippetList == nullptr) {
-            DisplayErrorMessage(L"Failed to get snippet list");
-            return result;
-        }
-        checkAndClearException(env);
-        jclass listClass = cache.getClass(env, "SnippetList", snippetList);//env->GetObjectClass(snippetList);
-        if (listClass == nullptr) {
-            DisplayErrorMessage(L"Failed to get list class");
-            return result;
+    if (command == "release session") {
+        ReleaseSession(session);
+        return result;
+    }
+    if (command.compare(0, 8, "release ") == 0) {
+        return ReleaseHandle(command.substr(8), session);
+    }
+
+    // Handle references are swapped for the JShell variables that hold the objects.
+    std::string instruction = request;
+    std::string error;
+    bool pin = instruction.compare(0, 5, "<PIN>") == 0;
+    if (pin) {
+        instruction.erase(0, 5);
+    }
+    if (!handles.RewriteReferences(instruction, session, error)) {
+        return Fail(ErrorCode::HandleError, error);
+    }
+    if (instruction.compare(0, 8, "<HANDLE>") == 0) {
+        return CreateHandle(instruction.substr(8), session);
+    }
+
+    if (!this->shell) {
+        return Fail(ErrorCode::NoShell, "Failed to get shell");
+    }
+
+    jstring jString = strings.New(env, instruction);
+    auto evalStart = std::chrono::steady_clock::now();
+    jobject snippetList = env->CallObjectMethod(shell, eval, jString);
+    snippetStats.RecordEval(static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - evalStart).count()));
+    if (!Require(snippetList != nullptr, ErrorCode::JavaException, "Failed to get snippet list")) {
+        return result;
+    }
+    jclass listClass = cache.getClass(env, "SnippetList", snippetList);//env->GetObjectClass(snippetList);
+    jmethodID sizeMethod = cache.getMethodID(env, "SnippetList_size", listClass, "size", "()I");
+    jmethodID getMethod = cache.getMethodID(env, "SnippetList_get", listClass, "get", "(I)Ljava/lang/Object;");
+    if (!Require(sizeMethod != nullptr && getMethod != nullptr, ErrorCode::JniFailure, "Failed to get list methods")) {
+        return result;
+    }
+    // An empty list means there was nothing to evaluate (blank input or only a comment).
+    jint listSize = env->CallIntMethod(snippetList, sizeMethod);
+
+    jclass statusClass = cache.findClass(env, "jdk/jshell/Snippet$Status");
+    jobject rejected = statusClass ? cache.getObject(env, "SnippetStatus_REJECTED", statusClass, "REJECTED", "Ljdk/jshell/Snippet$Status;") : nullptr;
+
+    std::string resultString = "";
+    for (jint i = 0; i < listSize; i++) {
+        jobject event = env->CallObjectMethod(snippetList, getMethod, i);
+        jclass snippetClass = cache.getClass(env, "Snippet", event);
+        jmethodID valueMethod = cache.getMethodID(env, "ValueMethod", snippetClass, "value", "()Ljava/lang/String;");
+        jstring valueString = (jstring)env->CallObjectMethod(event, valueMethod);
+        if (valueString != nullptr) {
+            // Values are converted straight onto the end of the response.
+            JniStrings::Append(env, valueString, resultString);
+            env->DeleteLocalRef(valueString);
+            continue;
         }
-        checkAndClearException(env);
-        jmethodID sizeMethod = cache.getMethodID(env, "SnippetList_size", listClass, "size", "()I");
-        if (sizeMethod == nullptr) {
-            DisplayErrorMessage(L"Failed to get size method");
-            return result;
+
+        jmethodID exception = cache.getMethodID(env, "SnippetException", snippetClass, "exception", "()Ljdk/jshell/JShellException;");
+        jobject exceptionObject = env->CallObjectMethod(event, exception);
+        if (exceptionObject != nullptr) {
+            if (!failure.Failed()) {
+                failure = DescribeThrowable((jthrowable)exceptionObject, ErrorCode::SnippetException);
+            }
+            break;
         }
-        checkAndClearException(env);
-        jint listSize = env->CallIntMethod(snippetList, sizeMethod);
-        if (listSize == 0) {
-            DisplayErrorMessage(L"List size is 0");
-            return result;
+
+        jmethodID statusMethod = cache.getMethodID(env, "SnippetEventStatus", snippetClass, "status", "()Ljdk/jshell/Snippet$Status;");
+        jobject status = env->CallObjectMethod(event, statusMethod);
+        if (rejected != nullptr && env->IsSameObject(status, rejected)) {
+            jmethodID snippetMethod = cache.getMethodID(env, "SnippetEventSnippet", snippetClass, "snippet", "()Ljdk/jshell/Snippet;");
+            jobject snippet = env->CallObjectMethod(event, snippetMethod);
+            Fail(ErrorCode::SnippetRejected, RejectionMessage(snippet));
+            break;
         }
-        checkAndClearException(env);
+
+        // Declarations have no value; describe the event instead.
+        jmethodID toString = cache.getMethodID(env, "SnippetToString", snippetClass, "toString", "()Ljava/lang/String;");
+        jstring description = CallStringMethod(env, event, toString);
+        JniStrings::Append(env, description, resultString);
+        env->DeleteLocalRef(description);
+    }
+    CheckException();
+
+    // Expressions and statements are done with once their value has been read; keeping
+    // them (and their $N temp variables) alive only grows the shell. Pinned bootstrap
+    // declarations are remembered so a rebuilt shell can be brought back to this state.
+    if (pin && !failure.Failed()) {
+        pinnedSources.push_back(instruction);
+        snippetStats.pinned = pinnedSources.size();
+    }
+    else {
+        DropTransient(snippetList, listSize, getMethod);
+    }
+
+    return resultString;
+}
+
+std::string JavaAPI::CreateHandle(std::string expression, uint32_t session) {
+    if (!this->shell) {
+        return Fail(ErrorCode::NoShell, "Failed to get shell");
+    }
+    while (!expression.empty() && (expression.back() == ';' || isspace(static_cast<unsigned char>(expression.back())))) {
+        expression.pop_back();
+    }
+
+    uint32_t slot = 0;
+    std::string error;
+    if (!handles.Allocate(session, slot, error)) {
+        return Fail(ErrorCode::HandleError, error);
+    }
+
+    // Declaring a variable keeps the object reachable and gives it a static type, so later
+    // snippets can call methods on it directly.
+    std::string declaration = "var " + HandleTable::VariableName(slot) + " = " + expression + ";";
+    jstring jString = strings.New(env, declaration);
+    jobject snippetList = env->CallObjectMethod(shell, eval, jString);
+    env->DeleteLocalRef(jString);
+    CheckException();
+
+    jobject snippet = nullptr;
+    if (snippetList != nullptr) {
+        jclass listClass = cache.getClass(env, "SnippetList", snippetList);
+        jmethodID sizeMethod = cache.getMethodID(env, "SnippetList_size", listClass, "size", "()I");
         jmethodID getMethod = cache.getMethodID(env, "SnippetList_get", listClass, "get", "(I)Ljava/lang/Object;");
-        if (getMethod == nullptr) {
-            DisplayErrorMessage(L"Failed to get get method");
-            return result;
-        }
-        checkAndClearException(env);
-        std::string resultString = "";
-        for (jint i = 0; i < listSize; i++) {
-            jobject snippet = env->CallObjectMethod(snippetList, getMethod, i);
-            jclass snippetClass = cache.getClass(env, "Snippet", snippet);
-            jmethodID valueMethod = cache.getMethodID(env, "ValueMethod", snippetClass, "value", "()Ljava/lang/String;");
-            //jmethodID dropMethod = cache.getMethodID(env, "SnippetDrop", snippetClass, "drop", "()V");
-            jstring valueString = (jstring)env->CallObjectMethod(snippet, valueMethod);
-            if (valueString == nullptr) {
-                jmethodID exception = cache.getMethodID(env, "SnippetException", snippetClass, "exception", "()Ljdk/jshell/JShellException;");
-                jobject exceptionObject = env->CallObjectMethod(snippet, exception);
-                if (exceptionObject == nullptr) {
-                    jmethodID toString = cache.getMethodID(env, "SnippetToString", snippetClass, "toString", "()Ljava/lang/String;");
-                    jstring toStringString = (jstring)env->CallObjectMethod(snippet, toString);
-                    if (toStringString != nullptr) {
-                        resultString += (std::string)env->GetStringUTFChars(toStringString, NULL);
-                        continue;
-                    }
-                }
-                else {
-                    jclass exceptionClass = cache.getClass(env, "ExceptionClass", exceptionObject);
-                    jmethodID getMessage = cache.getMethodID(env, "ExceptionGetMethod", exceptionClass, "getMessage", "()Ljava/lang/String;");
-
-                    jstring message = (jstring)env->CallObjectMethod(exceptionObject, getMessage);
-                    if (message == nullptr) {
-                        break;
-                    }
-                    checkAndClearException(env);
-                    const char* utf8Chars = env->GetStringUTFChars(message, NULL);
-                    resultString += (std::string)utf8Chars;
-                    env->ReleaseStringUTFChars(message, utf8Chars);
-                    break;
+        if (env->CallIntMethod(snippetList, sizeMethod) > 0) {
+            jobject event = env->CallObjectMethod(snippetList, getMethod, 0);
+            jclass eventClass = cache.getClass(env, "Snippet", event);
+            jmethodID snippetMethod = cache.getMethodID(env, "SnippetEventSnippet", eventClass, "snippet", "()Ljdk/jshell/Snippet;");
+            jmethodID statusMethod = cache.getMethodID(env, "SnippetEventStatus", eventClass, "status", "()Ljdk/jshell/Snippet$Status;");
+            jmethodID exceptionMethod = cache.getMethodID(env, "SnippetException", eventClass, "exception", "()Ljdk/jshell/JShellException;");
+
+            snippet = env->CallObjectMethod(event, snippetMethod);
+            jobject status = env->CallObjectMethod(event, statusMethod);
+            jobject exceptionObject = env->CallObjectMethod(event, exceptionMethod);
+            jclass statusClass = cache.findClass(env, "jdk/jshell/Snippet$Status");
+            jobject valid = statusClass ? cache.getObject(env, "SnippetStatus_VALID", statusClass, "VALID", "Ljdk/jshell/Snippet$Status;") : nullptr;
+            CheckException();
+
+            if (exceptionObject == nullptr && valid != nullptr && env->IsSameObject(status, valid)) {
+                handles.Bind(slot, env->NewGlobalRef(snippet));
+                return HandleTable::Token(handles.Id(slot));
+            }
+            if (exceptionObject != nullptr) {
+                if (!failure.Failed()) {
+                    failure = DescribeThrowable((jthrowable)exceptionObject, ErrorCode::SnippetException);
                 }
             }
-            checkAndClearException(env);
+            else {
+                Fail(ErrorCode::SnippetRejected, RejectionMessage(snippet));
+            }
+        }
+    }
+    Fail(ErrorCode::HandleError, "Failed to create handle");
+
+    if (snippet != nullptr) {
+        DropSnippet(snippet);
+    }
+    handles.Release(slot);
+    return std::string();
+}
+
+std::string JavaAPI::ReleaseHandle(const std::string& token, uint32_t session) {
+    std::string reference = token;
+    while (!reference.empty() && (reference.back() == ';' || isspace(static_cast<unsigned char>(reference.back())))) {
+        reference.pop_back();
+    }
+
+    const std::string open = "$h{";
+    if (reference.compare(0, open.size(), open) == 0 && reference.back() == '}') {
+        reference = reference.substr(open.size(), reference.size() - open.size() - 1);
+    }
 
-            //env->CallVoidMethod(snippet, dropMethod);
+    uint32_t id = 0;
+    uint32_t slot = 0;
+    if (!HandleTable::ParseId(reference, id) || !handles.Resolve(id, session, slot)) {
+        return Fail(ErrorCode::HandleError, "Invalid or released handle " + token);
+    }
+
+    jobject snippet = handles.Release(slot);
+    if (snippet != nullptr) {
+        DropSnippet(snippet);
+        env->DeleteGlobalRef(snippet);
+    }
+    ForgetHandleReads();
+    return "released";
+}
 
-            const char* utf8Chars = env->GetStringUTFChars(valueString, NULL);
-            resultString += (std::string)utf8Chars;
-            env->ReleaseStringUTFChars(valueString, utf8Chars);
+void JavaAPI::ReleaseSession(uint32_t session) {
+    std::vector<uint32_t> slots = handles.SessionSlots(session);
+    for (uint32_t slot : slots) {
+        jobject snippet = handles.Release(slot);
+        if (snippet != nullptr) {
+            DropSnippet(snippet);
+            env->DeleteGlobalRef(snippet);
         }
+    }
+    if (!slots.empty()) {
+        ForgetHandleReads();
+    }
+}
 
-        return resultString;
+void JavaAPI::DropSnippet(jobject snippet) {
+    if (!this->shell) {
+        return;
     }
-    else {
-        DisplayErrorMessage(L"Failed to get shell");
-        return result;
+    jclass shellClass = cache.getClass(env, "JShellClass", shell);
+    jmethodID drop = cache.getMethodID(env, "JShellDrop", shellClass, "drop", "(Ljdk/jshell/Snippet;)Ljava/util/List;");
+    if (drop == nullptr) {
+        return;
     }
+    jobject events = env->CallObjectMethod(shell, drop, snippet);
+    DiscardException();
+    if (events != nullptr) {
+        env->DeleteLocalRef(events);
+    }
+}
 
+bool JavaAPI::IsTransient(jobject snippet) {
+    jclass snippetClass = cache.findClass(env, "jdk/jshell/Snippet");
+    jclass subKindClass = cache.findClass(env, "jdk/jshell/Snippet$SubKind");
+    if (snippetClass == nullptr || subKindClass == nullptr) {
+        return false;
+    }
+    jmethodID subKindMethod = cache.getMethodID(env, "Snippet_subKind", snippetClass, "subKind", "()Ljdk/jshell/Snippet$SubKind;");
+    jmethodID isPersistent = cache.getMethodID(env, "SubKind_isPersistent", subKindClass, "isPersistent", "()Z");
+    jobject tempVar = cache.getObject(env, "SubKind_TEMP_VAR", subKindClass, "TEMP_VAR_EXPRESSION_SUBKIND", "Ljdk/jshell/Snippet$SubKind;");
+
+    jobject subKind = env->CallObjectMethod(snippet, subKindMethod);
+    DiscardException();
+    if (subKind == nullptr) {
+        return false;
+    }
+    bool transient = env->IsSameObject(subKind, tempVar) || !env->CallBooleanMethod(subKind, isPersistent);
+    DiscardException();
+    env->DeleteLocalRef(subKind);
+    return transient;
+}
+
+void JavaAPI::DropTransient(jobject snippetList, jint listSize, jmethodID getMethod) {
+    for (jint i = 0; i < listSize; i++) {
+        jobject event = env->CallObjectMethod(snippetList, getMethod, i);
+        if (event == nullptr) {
+            continue;
+        }
+        jclass eventClass = cache.getClass(env, "Snippet", event);
+        jmethodID snippetMethod = cache.getMethodID(env, "SnippetEventSnippet", eventClass, "snippet", "()Ljdk/jshell/Snippet;");
+        jobject snippet = env->CallObjectMethod(event, snippetMethod);
+        DiscardException();
+        if (snippet != nullptr && IsTransient(snippet)) {
+            DropSnippet(snippet);
+            snippetStats.dropped++;
+        }
+        env->DeleteLocalRef(snippet);
+        env->DeleteLocalRef(event);
+    }
+}
+
+void JavaAPI::CompactSnippets() {
+    if (!this->shell) {
+        return;
+    }
+    jclass shellClass = cache.getClass(env, "JShellClass", shell);
+    jclass streamClass = cache.findClass(env, "java/util/stream/Stream");
+    jclass statusClass = cache.findClass(env, "jdk/jshell/Snippet$Status");
+    if (streamClass == nullptr || statusClass == nullptr) {
+        return;
+    }
+    jmethodID snippetsMethod = cache.getMethodID(env, "JShellSnippets", shellClass, "snippets", "()Ljava/util/stream/Stream;");
+    jmethodID statusMethod = cache.getMethodID(env, "JShellStatus", shellClass, "status", "(Ljdk/jshell/Snippet;)Ljdk/jshell/Snippet$Status;");
+    jmethodID toArray = cache.getMethodID(env, "Stream_toArray", streamClass, "toArray", "()[Ljava/lang/Object;");
+    jmethodID isActive = cache.getMethodID(env, "Status_isActive", statusClass, "isActive", "()Z");
+
+    jobject stream = env->CallObjectMethod(shell, snippetsMethod);
+    jobjectArray all = stream ? (jobjectArray)env->CallObjectMethod(stream, toArray) : nullptr;
+    DiscardException();
+    if (all == nullptr) {
+        return;
+    }
+
+    // Anything transient still active slipped past DropTransient (e.g. an instruction that
+    // failed halfway); the rest is what a long session actually keeps alive.
+    jsize count = env->GetArrayLength(all);
+    size_t live = 0;
+    for (jsize i = 0; i < count; i++) {
+        jobject snippet = env->GetObjectArrayElement(all, i);
+        jobject status = env->CallObjectMethod(shell, statusMethod, snippet);
+        bool active = status != nullptr && env->CallBooleanMethod(status, isActive);
+        DiscardException();
+        if (active) {
+            if (IsTransient(snippet)) {
+                DropSnippet(snippet);
+                snippetStats.dropped++;
+            }
+            else {
+                live++;
+            }
+        }
+        env->DeleteLocalRef(status);
+        env->DeleteLocalRef(snippet);
+    }
+
+    snippetStats.live = live;
+    snippetStats.total = static_cast<size_t>(count);
+    snippetStats.compactions++;
+
+    // Dropped snippets stay in the shell's history; past the threshold only a fresh shell
+    // brings the cost back down. A fresh shell loses every handle variable, so while clients
+    // hold handles the rebuild waits for a later compaction; only "cleanup" forces it.
+    if (static_cast<size_t>(count) > RebuildThreshold) {
+        if (handles.LiveCount() > 0) {
+            snippetStats.rebuildsDeferred++;
+        }
+        else {
+            RebuildShell();
+        }
+    }
+}
+
+void JavaAPI::RebuildShell() {
+    jobject previous = env->NewGlobalRef(shell);
+    cleanup();
+
+    if (this->shell && !env->IsSameObject(previous, shell)) {
+        for (const std::string& source : pinnedSources) {
+            jstring jString = strings.New(env, source);
+            jobject events = env->CallObjectMethod(shell, eval, jString);
+            DiscardException();
+            env->DeleteLocalRef(events);
+            env->DeleteLocalRef(jString);
+        }
+        snippetStats.rebuilds++;
+    }
+    env->DeleteGlobalRef(previous);
+}
+
+std::string JavaAPI::Stats() {
+    std::ostringstream out;
+    out << "handles live=" << handles.LiveCount() << "\n";
+    out << "snippets live=" << snippetStats.live
+        << " total=" << snippetStats.total
+        << " pinned=" << snippetStats.pinned
+        << " dropped=" << snippetStats.dropped
+        << " compactions=" << snippetStats.compactions
+        << " rebuilds=" << snippetStats.rebuilds
+        << " rebuilds_deferred=" << snippetStats.rebuildsDeferred
+        << "\n";
+    out << "eval count=" << snippetStats.evals
+        << " first_window_avg_us=" << snippetStats.firstWindowMicros
+        << " recent_window_avg_us=" << snippetStats.recentWindowMicros
+        << "\n";
+    out << errorStats.Format();
+    return out.str();
 }
 
 void JavaAPI::cleanup() {
+    // The shell may be replaced, taking the handle variables with it.
+    for (uint32_t slot : handles.LiveSlots()) {
+        jobject snippet = handles.Release(slot);
+        if (snippet != nullptr) {
+            DropSnippet(snippet);
+            env->DeleteGlobalRef(snippet);
+        }
+    }
     getJShell();
 }
\ No newline at end of file
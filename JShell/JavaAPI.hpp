@@ -5,25 +5,81 @@
 #include <jni.h>
 #include <vector>
 #include <unordered_map>
+#include <atomic>
 #include "JNICache.hpp"
+#include "HandleTable.hpp"
+#include "Errors.hpp"
+#include "JniStrings.hpp"
 
+#ifdef _WIN32
 typedef int (*ptr_GCJavaVMs)(JavaVM** vmBuf, jsize bufLen, jsize* nVMs);
 typedef jobject(JNICALL* ptr_GetComponent)(JNIEnv* env, void* platformInfo);
+#endif
 
 struct AWTRectangle
 {
     int x, y, width, height;
 };
 
+// Counters for the snippet lifecycle policy. Written by the evaluator thread, read by stats.
+struct SnippetStats
+{
+    static const unsigned long long WindowSize = 1000;
+
+    std::atomic<unsigned long long> evals{ 0 };
+    std::atomic<unsigned long long> dropped{ 0 };
+    std::atomic<unsigned long long> compactions{ 0 };
+    std::atomic<unsigned long long> rebuilds{ 0 };
+    std::atomic<unsigned long long> rebuildsDeferred{ 0 }; // postponed while handles are live
+    std::atomic<size_t> live{ 0 };
+    std::atomic<size_t> total{ 0 };
+    std::atomic<size_t> pinned{ 0 };
+    // Average eval time of the first window and of the latest complete window; comparing
+    // the two shows whether eval cost is creeping up over a long session.
+    std::atomic<unsigned long long> firstWindowMicros{ 0 };
+    std::atomic<unsigned long long> recentWindowMicros{ 0 };
+    unsigned long long windowMicros = 0;
+    unsigned long long windowCount = 0;
+
+    void RecordEval(unsigned long long micros);
+};
+
 class JavaAPI {
 public:
     JavaAPI();
-    std::string ProcessInstruction(const std::string& instruction);
+    ~JavaAPI();
+    std::string ProcessInstruction(const std::string& instruction, uint32_t session = 0);
+    std::string CreateHandle(std::string expression, uint32_t session);
+    std::string ReleaseHandle(const std::string& token, uint32_t session);
+    void ReleaseSession(uint32_t session);
+    void DropSnippet(jobject snippet);
+    bool IsTransient(jobject snippet);
+    void DropTransient(jobject snippetList, jint listSize, jmethodID getMethod);
+    void CompactSnippets();
+    void RebuildShell();
+    std::string Stats();
+    // Game tick batching (JavaAPITick.cpp). TickCount returns the client's tick counter, or
+    // -1 while there is no client. ProcessTick evaluates the expressions queued for one tick
+    // together in a single client thread callback, one response per instruction; `batched`
+    // is cleared if the callback could not run, in which case the reads are answered with
+    // errors rather than run anywhere else.
+    jint TickCount();
+    std::vector<std::string> ProcessTick(const std::vector<std::string>& instructions, const std::vector<uint32_t>& sessions, bool& batched);
+    // Frame capture (JavaAPICapture.cpp). Copies the part of the client's frame inside
+    // `requested` (all of it if empty), clipped to the frame and to maxWidth x maxHeight,
+    // into `pixels` as rows of 0x00RRGGBB; `captured` is the region copied. With null
+    // `pixels` only the region and the frame size are worked out.
+    bool ReadFrame(const AWTRectangle& requested, int maxWidth, int maxHeight, uint32_t* pixels,
+        AWTRectangle& captured, int& frameWidth, int& frameHeight);
+    // Attaches the calling thread and locates the game canvas. Platform specific:
+    // JavaAPIWin32.cpp goes through the native window, JavaAPIPosix.cpp asks the client.
     jobject GrabCanvas();
+#ifdef _WIN32
     HWND GetCanvasHWND();
     HWND FindWindowWithClassName(const std::vector<HWND>& windows, const wchar_t* className);
     HWND FindWindowWithTitle(const std::vector<HWND>& windows, const wchar_t* windowTitle);
     HWND GetNestedCanvas(HWND parent, const wchar_t* className);
+#endif
     bool AttachToThread(JNIEnv** Thread);
     bool DetachThread(JNIEnv** Thread);
     void cleanup();
@@ -32,11 +88,53 @@ public:
 
     // Initialize cache in JavaAPI constructor
     JniCache& cache;
+    HandleTable handles;
+
+    // Compact after this many evals; rebuild the shell once its history exceeds the limit.
+    static const unsigned long long CompactionInterval = 1000;
+    static const size_t RebuildThreshold = 20000;
+    // Frames of a Java stack trace included in an error response.
+    static const jsize MaxStackFrames = 16;
+    // How long a tick batch waits for the client thread to run it.
+    static const long TickTimeoutMillis = 2000;
 
 private:
+    std::string Evaluate(const std::string& request, uint32_t session);
+
+    // Failures of the instruction being processed. The first one is kept and sent back in
+    // place of the value (see Errors.hpp); nothing here may block the evaluator thread.
+    // Returns true if an exception was pending; it is cleared and recorded.
+    bool CheckException(ErrorCode code = ErrorCode::JavaException, const std::string& context = std::string());
+    // Clears a pending exception from housekeeping without failing the instruction.
+    void DiscardException();
+    // Records a failure without an exception; returns the empty value to hand back.
+    std::string Fail(ErrorCode code, const std::string& message);
+    // Fails the instruction with `message` unless `ok` holds and no exception is pending.
+    bool Require(bool ok, ErrorCode code, const std::string& message);
+    ErrorInfo DescribeThrowable(jthrowable throwable, ErrorCode code);
+    std::string RejectionMessage(jobject snippet);
+    std::string ReadString(jstring string);
+    // Looks the client up if it is not known yet, without failing the current instruction.
+    bool EnsureClient();
+    // Declares the $Tick helper in the current shell if it is not yet; false, with the
+    // failure recorded, if it cannot be.
+    bool EnsureTickHelper();
+    // The id `expression` is compiled under as a tick read, compiling it on first use. False,
+    // with the error response in `response`, if it is not an expression with a value.
+    bool TickRead(const std::string& expression, bool usesHandles, jint& id, std::string& response);
+    // Hands the reads to ClientThread.invoke in one task and waits for it; false, with the
+    // failure recorded, if it did not run, `records` holding the helper's results otherwise.
+    bool RunTickBatch(const std::vector<jint>& ids, std::string& records);
+    // The shell was replaced, or a handle variable dropped: compiled reads are stale.
+    void ResetTickReads();
+    void ForgetHandleReads();
+
     JavaVM* jvm;
     JNIEnv* env;
+#ifdef _WIN32
     ptr_GetComponent GetComponent;
+    HWND clientHWND;
+#endif
 
     jobject injector;
     jobject client;
@@ -44,5 +142,21 @@ private:
     jobject shell;
     jobject jshellpanel;
     jmethodID eval;
-    HWND clientHWND;
+
+    // Declarations sent with <PIN>, replayed in order if the shell has to be rebuilt.
+    std::vector<std::string> pinnedSources;
+    SnippetStats snippetStats;
+    unsigned long long lastCompaction;
+    ErrorInfo failure;
+    ErrorStats errorStats;
+    JniStrings strings;
+    // The current shell's $Tick helper, or whether it failed to declare it, and the reads
+    // compiled in it so far by expression.
+    bool tickUnavailable;
+    jobject tickHelper;
+    jmethodID tickBatch;
+    jmethodID tickForget;
+    std::unordered_map<std::string, jint> tickReads;
+    std::vector<std::string> tickHandleReads; // reads that name handle variables
+    jint nextTickRead;
 };
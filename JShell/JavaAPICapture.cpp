@@ -0,0 +1,80 @@
+#include "pch.h"
+#include "JavaAPI.hpp"
+#include <algorithm>
+
+bool JavaAPI::ReadFrame(const AWTRectangle& requested, int maxWidth, int maxHeight, uint32_t* pixels,
+    AWTRectangle& captured, int& frameWidth, int& frameHeight) {
+    if (!EnsureClient()) {
+        return false;
+    }
+
+    // The client renders into its buffer provider's int[]; reading that directly is what
+    // makes capture cheap and immune to the window being covered. With the GPU plugin on,
+    // the pixels are not kept up to date.
+    env->PushLocalFrame(16);
+    bool ok = false;
+    do {
+        jclass clientClass = cache.getClass(env, "ClientClass", client);
+        jmethodID getBufferProvider = cache.getMethodID(env, "Client_getBufferProvider", clientClass, "getBufferProvider", "()Lnet/runelite/api/BufferProvider;");
+        if (getBufferProvider == nullptr) {
+            break;
+        }
+        jobject provider = env->CallObjectMethod(client, getBufferProvider);
+        if (env->ExceptionCheck() || provider == nullptr) {
+            break;
+        }
+        // Looked up through the interface: the client may swap providers of other classes.
+        jclass providerClass = cache.findClass(env, "net/runelite/api/BufferProvider");
+        if (providerClass == nullptr) {
+            break;
+        }
+        jmethodID getPixels = cache.getMethodID(env, "BufferProvider_getPixels", providerClass, "getPixels", "()[I");
+        jmethodID getWidth = cache.getMethodID(env, "BufferProvider_getWidth", providerClass, "getWidth", "()I");
+        jmethodID getHeight = cache.getMethodID(env, "BufferProvider_getHeight", providerClass, "getHeight", "()I");
+        if (getPixels == nullptr || getWidth == nullptr || getHeight == nullptr) {
+            break;
+        }
+        frameWidth = env->CallIntMethod(provider, getWidth);
+        frameHeight = env->CallIntMethod(provider, getHeight);
+        jintArray frame = (jintArray)env->CallObjectMethod(provider, getPixels);
+        if (env->ExceptionCheck() || frame == nullptr || frameWidth <= 0 || frameHeight <= 0
+            || env->GetArrayLength(frame) < static_cast<jsize>(frameWidth) * frameHeight) {
+            break;
+        }
+
+        bool whole = requested.width <= 0 || requested.height <= 0;
+        captured.x = whole ? 0 : (std::max)(requested.x, 0);
+        captured.y = whole ? 0 : (std::max)(requested.y, 0);
+        int right = whole ? frameWidth : (std::min)(requested.x + requested.width, frameWidth);
+        int bottom = whole ? frameHeight : (std::min)(requested.y + requested.height, frameHeight);
+        captured.width = (std::min)(right - captured.x, maxWidth);
+        captured.height = (std::min)(bottom - captured.y, maxHeight);
+        if (captured.width <= 0 || captured.height <= 0) {
+            break;
+        }
+
+        if (pixels != nullptr) {
+            jint* out = reinterpret_cast<jint*>(pixels);
+            if (captured.x == 0 && captured.width == frameWidth) {
+                // Whole rows are contiguous in the frame, so one copy does.
+                env->GetIntArrayRegion(frame, captured.y * frameWidth, captured.width * captured.height, out);
+            }
+            else {
+                for (int row = 0; row < captured.height; row++) {
+                    env->GetIntArrayRegion(frame, (captured.y + row) * frameWidth + captured.x, captured.width, out + row * captured.width);
+                }
+            }
+            if (env->ExceptionCheck()) {
+                break;
+            }
+        }
+        ok = true;
+    } while (false);
+
+    // A capture that failed is retried with the next frame; it fails no instruction.
+    if (env->ExceptionCheck()) {
+        env->ExceptionClear();
+    }
+    env->PopLocalFrame(nullptr);
+    return ok;
+}
@@ -0,0 +1,38 @@
+#include "pch.h"
+#include "JavaAPI.hpp"
+
+jobject JavaAPI::GrabCanvas() {
+    // Without a native window to start from, the canvas comes from the client itself.
+    jsize nVMs = 0;
+    if (!this->jvm && (JNI_GetCreatedJavaVMs(&this->jvm, 1, &nVMs) != JNI_OK || nVMs == 0)) {
+        Fail(ErrorCode::NoCanvas, "get jvm failure");
+        return nullptr;
+    }
+    if (!this->AttachToThread(&env)) {
+        Fail(ErrorCode::NoCanvas, "attach failure");
+        return nullptr;
+    }
+
+    if (!this->client && !getClient()) {
+        return nullptr;
+    }
+
+    jclass clientClass = env->GetObjectClass(this->client);
+    jmethodID getCanvas = cache.getMethodID(env, "Client_getCanvas", clientClass, "getCanvas", "()Ljava/awt/Canvas;");
+    env->DeleteLocalRef(clientClass);
+    if (!getCanvas) {
+        Fail(ErrorCode::NoCanvas, "get canvas failure");
+        return nullptr;
+    }
+
+    jobject tempCanvas = env->CallObjectMethod(this->client, getCanvas);
+    if (!Require(tempCanvas != nullptr, ErrorCode::NoCanvas, "get canvas failure")) {
+        return nullptr;
+    }
+    if (this->canvas) {
+        env->DeleteGlobalRef(this->canvas);
+    }
+    this->canvas = env->NewGlobalRef(tempCanvas);
+    env->DeleteLocalRef(tempCanvas);
+    return this->canvas;
+}
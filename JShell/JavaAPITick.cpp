@@ -0,0 +1,410 @@
+#include "pch.h"
+#include "JavaAPI.hpp"
+#include <cctype>
+#include <iostream>
+
+namespace {
+    // Declared once per shell. Each distinct read is compiled once, as a Callable stored
+    // under an id by define(); a tick then costs no compilation at all. batch() wraps the
+    // reads of one tick in a FutureTask, which the evaluator hands to ClientThread.invoke
+    // itself, so they all see the state of the same tick. The task's result has one record
+    // per read:
+    //
+    //   'V' value   or   'E' exception class US message
+    //
+    // each terminated by RS (0x1E), with ESC (0x1B) and RS in the text escaped by an ESC.
+    // Values are formatted the way JShell formats them, so a batched response looks the same
+    // as one evaluated on its own.
+    const char* TickHelperSource = R"java(class $Tick {
+    static final java.util.Map<Integer, java.util.concurrent.Callable<?>> reads = new java.util.concurrent.ConcurrentHashMap<>();
+
+    static void define(int id, java.util.concurrent.Callable<?> read) {
+        reads.put(id, read);
+    }
+
+    void forget(int id) {
+        reads.remove(id);
+    }
+
+    java.util.concurrent.FutureTask<String> batch(int[] ids) {
+        java.util.concurrent.Callable<?>[] batch = new java.util.concurrent.Callable<?>[ids.length];
+        for (int i = 0; i < ids.length; i++) {
+            batch[i] = reads.get(ids[i]);
+        }
+        return new java.util.concurrent.FutureTask<>(() -> {
+            StringBuilder out = new StringBuilder();
+            for (java.util.concurrent.Callable<?> read : batch) {
+                try {
+                    record(out, 'V', value(read.call()));
+                } catch (Throwable t) {
+                    record(out, 'E', t.getClass().getName() + '\u001f' + t.getMessage());
+                }
+            }
+            return out.toString();
+        });
+    }
+
+    static void record(StringBuilder out, char kind, String text) {
+        out.append(kind);
+        for (int i = 0; i < text.length(); i++) {
+            char c = text.charAt(i);
+            if (c == '\u001b' || c == '\u001e') {
+                out.append('\u001b');
+            }
+            out.append(c);
+        }
+        out.append('\u001e');
+    }
+
+    static String value(Object value) {
+        if (value == null) {
+            return "null";
+        }
+        if (value instanceof String) {
+            return quote((String) value, '"');
+        }
+        if (value instanceof Character) {
+            return quote(value.toString(), '\'');
+        }
+        if (value.getClass().isArray()) {
+            Class<?> type = value.getClass();
+            int dimensions = 0;
+            while (type.isArray()) {
+                type = type.getComponentType();
+                dimensions++;
+            }
+            String name = type.getTypeName();
+            int length = java.lang.reflect.Array.getLength(value);
+            StringBuilder out = new StringBuilder(name.substring(name.lastIndexOf('.') + 1));
+            out.append('[').append(length).append(']');
+            for (int i = 1; i < dimensions; i++) {
+                out.append("[]");
+            }
+            out.append(" { ");
+            for (int i = 0; i < length; i++) {
+                out.append(i > 0 ? ", " : "").append(value(java.lang.reflect.Array.get(value, i)));
+            }
+            return out.append(length > 0 ? " }" : "}").toString();
+        }
+        return value.toString();
+    }
+
+    static String quote(String text, char delimiter) {
+        StringBuilder out = new StringBuilder().append(delimiter);
+        for (int i = 0; i < text.length(); i++) {
+            char c = text.charAt(i);
+            switch (c) {
+            case '\b': out.append("\\b"); break;
+            case '\t': out.append("\\t"); break;
+            case '\n': out.append("\\n"); break;
+            case '\f': out.append("\\f"); break;
+            case '\r': out.append("\\r"); break;
+            default:
+                if (c == delimiter || c == '\\') {
+                    out.append('\\').append(c);
+                } else if (c < 256 && Character.isISOControl(c)) {
+                    out.append(String.format("\\%03o", (int) c));
+                } else {
+                    out.append(c);
+                }
+            }
+        }
+        return out.append(delimiter).toString();
+    }
+})java";
+
+    const char* TickHelperProperty = "jshell.tick.helper";
+
+    const char RecordSeparator = '\x1e';
+    const char RecordEscape = '\x1b';
+    const char UnitSeparator = '\x1f';
+
+    // Splits the helper's records into (kind, text) pairs.
+    bool SplitRecords(const std::string& records, std::vector<std::pair<char, std::string>>& out) {
+        size_t i = 0;
+        while (i < records.size()) {
+            char kind = records[i++];
+            std::string text;
+            bool terminated = false;
+            while (i < records.size()) {
+                char c = records[i++];
+                if (c == RecordEscape && i < records.size()) {
+                    text += records[i++];
+                }
+                else if (c == RecordSeparator) {
+                    terminated = true;
+                    break;
+                }
+                else {
+                    text += c;
+                }
+            }
+            if (!terminated || (kind != 'V' && kind != 'E')) {
+                return false;
+            }
+            out.emplace_back(kind, std::move(text));
+        }
+        return true;
+    }
+
+    // Everything that is not a plain expression is evaluated on its own: commands, pinned
+    // declarations and handle creation.
+    bool Batchable(const std::string& expression) {
+        return !expression.empty()
+            && expression != "cleanup"
+            && expression.compare(0, 8, "release ") != 0
+            && expression.compare(0, 5, "<PIN>") != 0
+            && expression.compare(0, 8, "<HANDLE>") != 0;
+    }
+}
+
+jint JavaAPI::TickCount() {
+    if (!EnsureClient()) {
+        return -1;
+    }
+    jclass clientClass = cache.getClass(env, "ClientClass", client);
+    jmethodID getTickCount = cache.getMethodID(env, "Client_getTickCount", clientClass, "getTickCount", "()I");
+    if (getTickCount == nullptr) {
+        return -1;
+    }
+    jint tick = env->CallIntMethod(client, getTickCount);
+    if (env->ExceptionCheck()) {
+        env->ExceptionClear();
+        return -1;
+    }
+    return tick;
+}
+
+std::vector<std::string> JavaAPI::ProcessTick(const std::vector<std::string>& instructions, const std::vector<uint32_t>& sessions, bool& batched) {
+    std::vector<std::string> responses(instructions.size());
+    std::vector<size_t> reads;
+    std::vector<jint> ids;
+    batched = true;
+    failure = ErrorInfo();
+    if (!this->shell) {
+        getJShell();
+    }
+    bool helper = EnsureTickHelper();
+    ErrorInfo batchFailure = failure;
+
+    for (size_t i = 0; i < instructions.size(); i++) {
+        std::string expression = instructions[i];
+        while (!expression.empty() && (expression.back() == ';' || isspace(static_cast<unsigned char>(expression.back())))) {
+            expression.pop_back();
+        }
+        if (!Batchable(expression)) {
+            responses[i] = ProcessInstruction(instructions[i], sessions[i]);
+            continue;
+        }
+        if (!helper) {
+            reads.push_back(i);
+            continue;
+        }
+        bool usesHandles = expression.find("$h{") != std::string::npos;
+        std::string error;
+        if (!handles.RewriteReferences(expression, sessions[i], error)) {
+            errorStats.Record(ErrorCode::HandleError);
+            responses[i] = ErrorInfo(ErrorCode::HandleError, error).Format();
+            continue;
+        }
+        jint id = 0;
+        if (!TickRead(expression, usesHandles, id, responses[i])) {
+            continue;
+        }
+        reads.push_back(i);
+        ids.push_back(id);
+    }
+
+    // Reads are never run off the client thread: they would no longer agree with each
+    // other, and nothing in the response could tell. They fail instead.
+    std::string records;
+    std::vector<std::pair<char, std::string>> results;
+    if (helper && !ids.empty() && (!RunTickBatch(ids, records) || !SplitRecords(records, results) || results.size() != ids.size())) {
+        batchFailure = failure.Failed() ? failure : ErrorInfo(ErrorCode::JniFailure, "Tick batch returned malformed results");
+        helper = false;
+    }
+    failure = ErrorInfo();
+    if (!helper) {
+        batched = reads.empty();
+        if (!batchFailure.Failed()) {
+            batchFailure = ErrorInfo(ErrorCode::JniFailure, "The $Tick helper is unavailable");
+        }
+        batchFailure.message = "Tick batch did not run on the client thread: " + batchFailure.message;
+        for (size_t i : reads) {
+            errorStats.Record(batchFailure.code);
+            responses[i] = batchFailure.Format();
+        }
+        return responses;
+    }
+
+    for (size_t i = 0; i < reads.size(); i++) {
+        if (results[i].first == 'V') {
+            responses[reads[i]] = std::move(results[i].second);
+            continue;
+        }
+        const std::string& text = results[i].second;
+        size_t separator = text.find(UnitSeparator);
+        ErrorInfo info(ErrorCode::SnippetException,
+            separator == std::string::npos ? std::string() : text.substr(separator + 1),
+            text.substr(0, separator));
+        errorStats.Record(info.code);
+        responses[reads[i]] = info.Format();
+    }
+    return responses;
+}
+
+bool JavaAPI::EnsureTickHelper() {
+    if (tickHelper != nullptr) {
+        return true;
+    }
+    if (!this->shell) {
+        Fail(ErrorCode::NoShell, "Failed to get shell");
+        return false;
+    }
+    if (tickUnavailable) {
+        Fail(ErrorCode::JniFailure, "The $Tick helper could not be declared in this shell");
+        return false;
+    }
+
+    env->PushLocalFrame(16);
+    // The helper lives in the shell's class loader, out of FindClass's reach; the instance
+    // is handed over through the system properties and its methods found on its class.
+    Evaluate(TickHelperSource, 0);
+    if (!failure.Failed()) {
+        Evaluate(std::string("System.getProperties().put(\"") + TickHelperProperty + "\", new $Tick())", 0);
+    }
+    jclass systemClass = cache.findClass(env, "java/lang/System");
+    jclass mapClass = cache.findClass(env, "java/util/Map");
+    jmethodID getProperties = systemClass ? env->GetStaticMethodID(systemClass, "getProperties", "()Ljava/util/Properties;") : nullptr;
+    jmethodID remove = mapClass ? cache.getMethodID(env, "Map_remove", mapClass, "remove", "(Ljava/lang/Object;)Ljava/lang/Object;") : nullptr;
+    if (!failure.Failed() && Require(getProperties != nullptr && remove != nullptr, ErrorCode::JniFailure, "Failed to find System.getProperties")) {
+        jobject properties = env->CallStaticObjectMethod(systemClass, getProperties);
+        jstring key = properties ? strings.New(env, TickHelperProperty) : nullptr;
+        jobject helper = key ? env->CallObjectMethod(properties, remove, key) : nullptr;
+        if (Require(helper != nullptr, ErrorCode::JniFailure, "The $Tick helper was not published")) {
+            jclass helperClass = env->GetObjectClass(helper);
+            tickBatch = env->GetMethodID(helperClass, "batch", "([I)Ljava/util/concurrent/FutureTask;");
+            tickForget = env->GetMethodID(helperClass, "forget", "(I)V");
+            if (Require(tickBatch != nullptr && tickForget != nullptr, ErrorCode::JniFailure, "Failed to find $Tick methods")) {
+                tickHelper = env->NewGlobalRef(helper);
+            }
+        }
+    }
+    env->PopLocalFrame(nullptr);
+
+    // Without the helper every batch would fail the same way; stop trying until the shell
+    // is replaced.
+    tickUnavailable = tickHelper == nullptr;
+    if (tickUnavailable) {
+        std::cerr << "Tick batching unavailable: " << failure.message << std::endl;
+    }
+    return tickHelper != nullptr;
+}
+
+bool JavaAPI::TickRead(const std::string& expression, bool usesHandles, jint& id, std::string& response) {
+    auto found = tickReads.find(expression);
+    if (found != tickReads.end()) {
+        id = found->second;
+        return true;
+    }
+
+    id = nextTickRead++;
+    // The line breaks keep a trailing // comment from swallowing the parenthesis.
+    failure = ErrorInfo();
+    env->PushLocalFrame(16);
+    Evaluate("$Tick.define(" + std::to_string(id) + ", () -> (\n" + expression + "\n))", 0);
+    env->PopLocalFrame(nullptr);
+    if (failure.Failed()) {
+        // Statements and void calls have no value to read; they belong in another lane.
+        ErrorInfo info = failure;
+        info.message = "Tick requests must be expressions with a value: " + info.message;
+        failure = ErrorInfo();
+        errorStats.Record(info.code);
+        response = info.Format();
+        return false;
+    }
+    tickReads[expression] = id;
+    if (usesHandles) {
+        tickHandleReads.push_back(expression);
+    }
+    return true;
+}
+
+bool JavaAPI::RunTickBatch(const std::vector<jint>& ids, std::string& records) {
+    failure = ErrorInfo();
+    if (!EnsureClient()) {
+        Fail(ErrorCode::NoClient, "The RuneLite client could not be reached");
+        return false;
+    }
+
+    env->PushLocalFrame(16);
+    bool ok = false;
+    do {
+        jclass clientThreadClass = cache.findClass(env, "net/runelite/client/callback/ClientThread");
+        jobject clientThread = clientThreadClass ? cache.getInjected(env, "ClientThread", injector, clientThreadClass) : nullptr;
+        jmethodID invoke = clientThread ? cache.getMethodID(env, "ClientThread_invoke", clientThreadClass, "invoke", "(Ljava/lang/Runnable;)V") : nullptr;
+        jclass futureClass = cache.findClass(env, "java/util/concurrent/Future");
+        jclass timeUnitClass = cache.findClass(env, "java/util/concurrent/TimeUnit");
+        jmethodID get = futureClass ? cache.getMethodID(env, "Future_getTimed", futureClass, "get", "(JLjava/util/concurrent/TimeUnit;)Ljava/lang/Object;") : nullptr;
+        jmethodID cancel = futureClass ? cache.getMethodID(env, "Future_cancel", futureClass, "cancel", "(Z)Z") : nullptr;
+        jobject milliseconds = timeUnitClass ? cache.getObject(env, "TimeUnit_MILLISECONDS", timeUnitClass, "MILLISECONDS", "Ljava/util/concurrent/TimeUnit;") : nullptr;
+        if (!Require(invoke != nullptr && get != nullptr && cancel != nullptr && milliseconds != nullptr,
+            ErrorCode::JniFailure, "Failed to find ClientThread.invoke")) {
+            break;
+        }
+
+        jintArray array = env->NewIntArray(static_cast<jsize>(ids.size()));
+        if (!Require(array != nullptr, ErrorCode::JniFailure, "Failed to allocate the tick batch")) {
+            break;
+        }
+        env->SetIntArrayRegion(array, 0, static_cast<jsize>(ids.size()), ids.data());
+        jobject task = env->CallObjectMethod(tickHelper, tickBatch, array);
+        if (!Require(task != nullptr, ErrorCode::JavaException, "Failed to build the tick batch")) {
+            break;
+        }
+        env->CallVoidMethod(clientThread, invoke, task);
+        if (CheckException(ErrorCode::JavaException, "ClientThread.invoke failed")) {
+            break;
+        }
+        jstring result = (jstring)env->CallObjectMethod(task, get, static_cast<jlong>(TickTimeoutMillis), milliseconds);
+        if (CheckException(ErrorCode::JavaException, "Client thread did not run the tick batch")) {
+            // Not run later either: its answers would no longer be waited for.
+            env->CallBooleanMethod(task, cancel, JNI_FALSE);
+            DiscardException();
+            break;
+        }
+        records = ReadString(result);
+        ok = true;
+    } while (false);
+    env->PopLocalFrame(nullptr);
+    return ok;
+}
+
+void JavaAPI::ResetTickReads() {
+    if (tickHelper != nullptr) {
+        env->DeleteGlobalRef(tickHelper);
+        tickHelper = nullptr;
+    }
+    tickBatch = nullptr;
+    tickForget = nullptr;
+    tickReads.clear();
+    tickHandleReads.clear();
+    tickUnavailable = false;
+}
+
+void JavaAPI::ForgetHandleReads() {
+    // A compiled read keeps the handle variable it was compiled against, even once a later
+    // handle reuses the name; reads that name handles are compiled again when next used.
+    for (const std::string& expression : tickHandleReads) {
+        auto found = tickReads.find(expression);
+        if (found == tickReads.end()) {
+            continue;
+        }
+        if (tickHelper != nullptr) {
+            env->CallVoidMethod(tickHelper, tickForget, found->second);
+            DiscardException();
+        }
+        tickReads.erase(found);
+    }
+    tickHandleReads.clear();
+}
@@ -0,0 +1,158 @@
+#include "pch.h"
+#include "JavaAPI.hpp"
+
+static BOOL CALLBACK GetHWNDCurrentPID(HWND WindowHandle, LPARAM lParam)
+{
+    auto handles = reinterpret_cast<std::vector<HWND>*>(lParam);
+    DWORD currentPID = GetCurrentProcessId();
+    DWORD windowPID;
+    GetWindowThreadProcessId(WindowHandle, &windowPID);
+
+    if (currentPID == windowPID)
+    {
+        handles->push_back(WindowHandle);
+    }
+
+
+    return TRUE;
+}
+
+HWND JavaAPI::FindWindowWithClassName(const std::vector<HWND>& windows, const wchar_t* className)
+{
+    wchar_t nameBuffer[128];
+
+    for (auto window : windows)
+    {
+        GetClassNameW(window, nameBuffer, sizeof(nameBuffer) / sizeof(wchar_t));  // Using the Unicode version
+        if (wcscmp(nameBuffer, className) == 0)  // Wide string comparison
+            return window;
+    }
+    return nullptr;
+}
+
+HWND JavaAPI::FindWindowWithTitle(const std::vector<HWND>& windows, const wchar_t* windowTitle)
+{
+    wchar_t titleBuffer[256]; // Adjust the size as needed
+    size_t titleLength = wcslen(windowTitle);
+
+    for (auto window : windows)
+    {
+        GetWindowTextW(window, titleBuffer, sizeof(titleBuffer) / sizeof(wchar_t));  // Using the Unicode version
+        // A logged-in client appends the account, as in "RuneLite - name".
+        if (wcsncmp(titleBuffer, windowTitle, titleLength) == 0
+            && (titleBuffer[titleLength] == L'\0' || titleBuffer[titleLength] == L' '))
+            return window;
+    }
+    return nullptr;
+}
+
+HWND JavaAPI::GetNestedCanvas(HWND parent, const wchar_t* className) {
+    HWND currentChild = GetWindow(parent, GW_CHILD);
+    while (currentChild) {
+        if (FindWindowWithClassName({ currentChild }, className)) {
+            HWND nestedChild = GetNestedCanvas(currentChild, className);
+            if (nestedChild) {
+                return nestedChild;
+            }
+        }
+        currentChild = GetWindow(currentChild, GW_HWNDNEXT);
+    }
+    return nullptr;
+}
+
+
+HWND JavaAPI::GetCanvasHWND() {
+    std::vector<HWND> matchedWindows;
+    EnumWindows(GetHWNDCurrentPID, reinterpret_cast<LPARAM>(&matchedWindows));
+
+    //HWND frameHandle = FindWindowWithClassName(matchedWindows, L"SunAwtFrame");
+    HWND frameHandle = FindWindowWithTitle(matchedWindows, L"RuneLite");
+
+    if (!frameHandle) {
+        Fail(ErrorCode::NoCanvas, "Failed to find frame");
+        return nullptr; // No parent frame found.
+    }
+    HWND canvasHandle = GetWindow(frameHandle, GW_CHILD);
+    if (!canvasHandle) {
+        Fail(ErrorCode::NoCanvas, "Failed to find canvas");
+        return nullptr;
+    }
+    clientHWND = frameHandle;
+    return canvasHandle;
+}
+
+jobject JavaAPI::GrabCanvas() {
+    HMODULE jvmDLL = GetModuleHandle(L"jvm.dll");
+    if (!jvmDLL) {
+        Fail(ErrorCode::NoCanvas, "get jvm.ll failure");
+        return nullptr;
+    }
+
+    ptr_GCJavaVMs getJVMs = (ptr_GCJavaVMs)GetProcAddress(jvmDLL, "JNI_GetCreatedJavaVMs");
+    if (!getJVMs) {
+        Fail(ErrorCode::NoCanvas, "get jvm failure");
+        return nullptr;
+    }
+    JNIEnv* thread = nullptr;
+
+    do {
+        getJVMs(&(this->jvm), 1, nullptr);
+        if (!this->jvm) {
+            Fail(ErrorCode::NoCanvas, "get jvm failure2");
+            break;
+        }
+
+        this->AttachToThread(&env);
+
+        HMODULE awtDLL = GetModuleHandle(L"awt.dll");
+        if (!awtDLL) {
+            Fail(ErrorCode::NoCanvas, "get awt dll failure");
+            break;
+        }
+
+        const char* awtFuncName = (sizeof(void*) == 8) ? "DSGetComponent" : "_DSGetComponent@8";
+        this->GetComponent = (ptr_GetComponent)GetProcAddress(awtDLL, awtFuncName);
+        if (!env || !this->GetComponent) {
+            Fail(ErrorCode::NoCanvas, "get component failure");
+            break;
+        }
+
+        HWND canvasHWND = GetCanvasHWND();
+        if (!canvasHWND) {
+            Fail(ErrorCode::NoCanvas, "get handle failure");
+            break;
+        }
+        jobject tempCanvas = this->GetComponent(env, (void*)canvasHWND);
+        if (!tempCanvas) {
+            Fail(ErrorCode::NoCanvas, "get component failure");
+            break;
+        }
+
+        jclass canvasClass = env->GetObjectClass(tempCanvas);
+        if (!canvasClass) {
+            Fail(ErrorCode::NoCanvas, "canvas object class failure");
+            break;
+        }
+
+        jmethodID canvas_getParent = env->GetMethodID(canvasClass, "getParent", "()Ljava/awt/Container;");
+        if (!canvas_getParent) {
+            Fail(ErrorCode::NoCanvas, "get parent failure");
+            break;
+        }
+
+        jobject tempClient = env->CallObjectMethod(tempCanvas, canvas_getParent);
+        if (tempClient) {
+            this->canvas = env->NewGlobalRef(tempClient);
+            env->DeleteLocalRef(tempClient);
+            return this->canvas;
+        }
+        else {
+            Fail(ErrorCode::NoCanvas, "get client failure");
+            break;
+        }
+        CheckException(ErrorCode::NoCanvas);
+        this->canvas = env->NewGlobalRef(tempClient);
+        return this->canvas;
+    } while (false);
+    return nullptr;
+}
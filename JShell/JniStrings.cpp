@@ -0,0 +1,220 @@
+#include "pch.h"
+#include "JniStrings.hpp"
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define JSHELL_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+    const uint32_t Replacement = 0xFFFD;
+
+    inline bool IsHighSurrogate(uint32_t c) {
+        return c >= 0xD800 && c <= 0xDBFF;
+    }
+
+    inline bool IsLowSurrogate(uint32_t c) {
+        return c >= 0xDC00 && c <= 0xDFFF;
+    }
+
+    inline size_t PutThreeBytes(uint32_t c, char* out) {
+        out[0] = static_cast<char>(0xE0 | (c >> 12));
+        out[1] = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+        out[2] = static_cast<char>(0x80 | (c & 0x3F));
+        return 3;
+    }
+
+    inline size_t PutCodePoint(uint32_t c, jchar* out) {
+        if (c < 0x10000) {
+            out[0] = static_cast<jchar>(c);
+            return 1;
+        }
+        c -= 0x10000;
+        out[0] = static_cast<jchar>(0xD800 + (c >> 10));
+        out[1] = static_cast<jchar>(0xDC00 + (c & 0x3FF));
+        return 2;
+    }
+}
+
+size_t JniStrings::Utf16ToUtf8(const jchar* in, size_t length, char* out) {
+    size_t i = 0;
+    size_t o = 0;
+    while (i < length) {
+#ifdef JSHELL_SSE2
+        // ASCII runs go 16 units at a time: no unit has a bit above 0x7F, so packing the
+        // units to bytes is the encoding.
+        const __m128i highBits = _mm_set1_epi16(static_cast<short>(0xFF80));
+        const __m128i zero = _mm_setzero_si128();
+        while (i + 16 <= length) {
+            __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+            __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 8));
+            __m128i wide = _mm_and_si128(_mm_or_si128(low, high), highBits);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(wide, zero)) != 0xFFFF) {
+                break;
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + o), _mm_packus_epi16(low, high));
+            i += 16;
+            o += 16;
+        }
+        if (i == length) {
+            break;
+        }
+#endif
+        uint32_t c = in[i++];
+        if (c < 0x80) {
+            out[o++] = static_cast<char>(c);
+        }
+        else if (c < 0x800) {
+            out[o++] = static_cast<char>(0xC0 | (c >> 6));
+            out[o++] = static_cast<char>(0x80 | (c & 0x3F));
+        }
+        else if (IsHighSurrogate(c) && i < length && IsLowSurrogate(in[i])) {
+            c = 0x10000 + ((c - 0xD800) << 10) + (in[i++] - 0xDC00);
+            out[o++] = static_cast<char>(0xF0 | (c >> 18));
+            out[o++] = static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+            out[o++] = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+            out[o++] = static_cast<char>(0x80 | (c & 0x3F));
+        }
+        else {
+            o += PutThreeBytes(IsHighSurrogate(c) || IsLowSurrogate(c) ? Replacement : c, out + o);
+        }
+    }
+    return o;
+}
+
+size_t JniStrings::Utf8ToUtf16(const char* in, size_t length, jchar* out) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(in);
+    size_t i = 0;
+    size_t o = 0;
+    while (i < length) {
+#ifdef JSHELL_SSE2
+        // ASCII runs go 16 bytes at a time, zero-extended to units.
+        const __m128i zero = _mm_setzero_si128();
+        while (i + 16 <= length) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + i));
+            if (_mm_movemask_epi8(chunk) != 0) {
+                break;
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + o), _mm_unpacklo_epi8(chunk, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + o + 8), _mm_unpackhi_epi8(chunk, zero));
+            i += 16;
+            o += 16;
+        }
+        if (i == length) {
+            break;
+        }
+#endif
+        unsigned char c = bytes[i];
+        if (c < 0x80) {
+            out[o++] = c;
+            i++;
+            continue;
+        }
+
+        // The ranges allowed for the second byte rule out overlong forms, surrogates and
+        // code points past U+10FFFF.
+        size_t needed = 0;
+        uint32_t value = 0;
+        unsigned char lower = 0x80;
+        unsigned char upper = 0xBF;
+        if (c >= 0xC2 && c <= 0xDF) {
+            needed = 1;
+            value = c & 0x1F;
+        }
+        else if (c >= 0xE0 && c <= 0xEF) {
+            needed = 2;
+            value = c & 0x0F;
+            lower = c == 0xE0 ? 0xA0 : 0x80;
+            upper = c == 0xED ? 0x9F : 0xBF;
+        }
+        else if (c >= 0xF0 && c <= 0xF4) {
+            needed = 3;
+            value = c & 0x07;
+            lower = c == 0xF0 ? 0x90 : 0x80;
+            upper = c == 0xF4 ? 0x8F : 0xBF;
+        }
+        size_t consumed = 1;
+        while (consumed <= needed && i + consumed < length) {
+            unsigned char next = bytes[i + consumed];
+            if (next < lower || next > upper) {
+                break;
+            }
+            value = (value << 6) | (next & 0x3F);
+            lower = 0x80;
+            upper = 0xBF;
+            consumed++;
+        }
+        // A malformed sequence becomes one replacement for its longest valid prefix, as
+        // Java's and Python's decoders do; the byte that broke it starts the next character.
+        o += PutCodePoint(needed > 0 && consumed > needed ? value : Replacement, out + o);
+        i += consumed;
+    }
+    return o;
+}
+
+bool JniStrings::IsPlainAscii(const char* data, size_t length) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    size_t i = 0;
+#ifdef JSHELL_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= length; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + i));
+        if ((_mm_movemask_epi8(chunk) | _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, zero))) != 0) {
+            return false;
+        }
+    }
+#endif
+    for (; i < length; i++) {
+        if (bytes[i] == 0 || bytes[i] >= 0x80) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void JniStrings::Append(JNIEnv* env, jstring string, std::string& out) {
+    if (string == nullptr) {
+        return;
+    }
+    jsize length = env->GetStringLength(string);
+    if (length <= 0) {
+        return;
+    }
+    // Modified UTF-8 is never shorter than UTF-8 (surrogate pairs take 6 bytes instead of 4,
+    // NUL 2 instead of 1), so its length bounds what is written here.
+    jsize utfLength = env->GetStringUTFLength(string);
+    size_t start = out.size();
+    if (utfLength == length) {
+        // One byte per character means every character is 0x01-0x7F and the JVM's bytes are
+        // already UTF-8. Room is left for the terminator HotSpot writes after the region.
+        out.resize(start + static_cast<size_t>(length) + 1);
+        env->GetStringUTFRegion(string, 0, length, &out[start]);
+        out.resize(start + static_cast<size_t>(length));
+        return;
+    }
+
+    size_t bound = utfLength > length ? static_cast<size_t>(utfLength) : 3 * static_cast<size_t>(length);
+    out.resize(start + bound);
+    // No JNI calls may be made until the characters are released; the conversion makes none.
+    const jchar* chars = env->GetStringCritical(string, nullptr);
+    if (chars == nullptr) {
+        env->ExceptionClear();
+        out.resize(start);
+        return;
+    }
+    size_t written = Utf16ToUtf8(chars, static_cast<size_t>(length), &out[start]);
+    env->ReleaseStringCritical(string, chars);
+    out.resize(start + written);
+}
+
+jstring JniStrings::New(JNIEnv* env, const std::string& text) {
+    if (IsPlainAscii(text.data(), text.size())) {
+        return env->NewStringUTF(text.c_str());
+    }
+    if (utf16.size() < text.size()) {
+        utf16.resize(text.size());
+    }
+    size_t units = Utf8ToUtf16(text.data(), text.size(), utf16.data());
+    return env->NewString(utf16.data(), static_cast<jsize>(units));
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "pch.h"
+#include <jni.h>
+#include <string>
+#include <vector>
+
+// Moves strings between Java and the wire as standard UTF-8.
+//
+// GetStringUTFChars and NewStringUTF speak modified UTF-8: characters outside the BMP become
+// two 3-byte surrogates and NUL becomes two bytes, so emoji and the like were mangled in
+// both directions. They also cost a JVM allocation plus a std::string copy per value. Pure
+// ASCII strings (the common case) are instead copied by the JVM straight into the caller's
+// buffer, and everything else is converted here from the string's UTF-16.
+class JniStrings {
+public:
+    // Appends the UTF-8 encoding of `string` to `out`; null appends nothing. Unpaired
+    // surrogates become U+FFFD. Does not delete the local reference.
+    static void Append(JNIEnv* env, jstring string, std::string& out);
+
+    // A new local reference to a Java string holding the UTF-8 text. Malformed sequences
+    // become U+FFFD. Returns null if the JVM could not allocate the string.
+    jstring New(JNIEnv* env, const std::string& text);
+
+    // The conversions themselves, usable without a JVM. `out` must have room for 3 bytes per
+    // UTF-16 unit and 1 unit per UTF-8 byte respectively; both return the amount written.
+    static size_t Utf16ToUtf8(const jchar* in, size_t length, char* out);
+    static size_t Utf8ToUtf16(const char* in, size_t length, jchar* out);
+    // True if every byte is in 0x01-0x7F, where UTF-8 and modified UTF-8 agree.
+    static bool IsPlainAscii(const char* data, size_t length);
+
+private:
+    // Reused across calls so an instruction costs no allocation once it has grown.
+    std::vector<jchar> utf16;
+};
@@ -0,0 +1,43 @@
+#pragma once
+#include "pch.h"
+#include <string>
+#include <cstdint>
+#include "Platform.hpp"
+
+// A file mapped read/write into memory that can be grown in place. Used for append-only
+// logs, where writers fill the mapping directly instead of going through WriteFile, and
+// for state shared between processes. MappedFileWin32.cpp and MappedFilePosix.cpp
+// implement it per platform.
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    void operator=(const MappedFile&) = delete;
+
+    // Creates or truncates the file; other processes may only read it. A `shared` file is
+    // opened as it is (created if missing) and other processes may map it read/write too.
+    bool Open(const std::string& path, uint64_t capacity, bool shared = false);
+    // Remaps with at least `capacity` bytes; existing contents are kept.
+    bool Grow(uint64_t capacity);
+    // Unmaps and truncates the file to `length` bytes; a shared file keeps its size.
+    void Close(uint64_t length);
+    void Flush();
+
+    char* Data() const { return data; }
+    uint64_t Capacity() const { return capacity; }
+    bool IsOpen() const { return data != nullptr; }
+
+private:
+    bool Map();
+    void Unmap();
+
+    NativeHandle file;
+#ifdef _WIN32
+    HANDLE mapping;
+#endif
+    char* data;
+    uint64_t capacity;
+    bool shared;
+};
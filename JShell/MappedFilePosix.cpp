@@ -0,0 +1,86 @@
+#include "pch.h"
+#include "MappedFile.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile()
+    : file(-1), data(nullptr), capacity(0), shared(false) {
+}
+
+MappedFile::~MappedFile() {
+    if (IsOpen()) {
+        Close(capacity);
+    }
+}
+
+bool MappedFile::Open(const std::string& path, uint64_t capacity, bool shared) {
+    file = open(path.c_str(), O_RDWR | O_CREAT | (shared ? 0 : O_TRUNC), shared ? 0666 : 0644);
+    if (file < 0) {
+        return false;
+    }
+
+    this->capacity = capacity;
+    this->shared = shared;
+    if (!Map()) {
+        close(file);
+        file = -1;
+        return false;
+    }
+    return true;
+}
+
+bool MappedFile::Map() {
+    // Unlike a Win32 section, a mapping does not extend the file by itself. A shared file
+    // may already be larger and is never shortened here.
+    struct stat info;
+    if (fstat(file, &info) != 0) {
+        return false;
+    }
+    if (static_cast<uint64_t>(info.st_size) < capacity && ftruncate(file, static_cast<off_t>(capacity)) != 0) {
+        return false;
+    }
+
+    void* view = mmap(nullptr, static_cast<size_t>(capacity), PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    if (view == MAP_FAILED) {
+        return false;
+    }
+    data = static_cast<char*>(view);
+    return true;
+}
+
+void MappedFile::Unmap() {
+    if (data) {
+        msync(data, static_cast<size_t>(capacity), MS_SYNC);
+        munmap(data, static_cast<size_t>(capacity));
+        data = nullptr;
+    }
+}
+
+bool MappedFile::Grow(uint64_t capacity) {
+    if (capacity <= this->capacity) {
+        return true;
+    }
+    Unmap();
+    this->capacity = capacity;
+    return Map();
+}
+
+void MappedFile::Flush() {
+    if (data) {
+        msync(data, static_cast<size_t>(capacity), MS_ASYNC);
+    }
+}
+
+void MappedFile::Close(uint64_t length) {
+    Unmap();
+    if (file >= 0) {
+        if (!shared && ftruncate(file, static_cast<off_t>(length)) != 0) {
+            // The log is still readable; it just keeps its unused tail.
+        }
+        close(file);
+        file = -1;
+    }
+    capacity = 0;
+}
@@ -0,0 +1,88 @@
+#include "pch.h"
+#include "MappedFile.hpp"
+
+MappedFile::MappedFile()
+    : file(INVALID_HANDLE_VALUE), mapping(NULL), data(nullptr), capacity(0), shared(false) {
+}
+
+MappedFile::~MappedFile() {
+    if (IsOpen()) {
+        Close(capacity);
+    }
+}
+
+bool MappedFile::Open(const std::string& path, uint64_t capacity, bool shared) {
+    DWORD sharing = shared ? FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE : FILE_SHARE_READ;
+    file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, sharing, NULL,
+        shared ? OPEN_ALWAYS : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    this->capacity = capacity;
+    this->shared = shared;
+    if (!Map()) {
+        CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+        return false;
+    }
+    return true;
+}
+
+bool MappedFile::Map() {
+    // Mapping a section larger than the file extends the file to that size.
+    mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE,
+        static_cast<DWORD>(capacity >> 32), static_cast<DWORD>(capacity & 0xFFFFFFFF), NULL);
+    if (!mapping) {
+        return false;
+    }
+
+    data = static_cast<char*>(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, static_cast<SIZE_T>(capacity)));
+    if (!data) {
+        CloseHandle(mapping);
+        mapping = NULL;
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::Unmap() {
+    if (data) {
+        FlushViewOfFile(data, 0);
+        UnmapViewOfFile(data);
+        data = nullptr;
+    }
+    if (mapping) {
+        CloseHandle(mapping);
+        mapping = NULL;
+    }
+}
+
+bool MappedFile::Grow(uint64_t capacity) {
+    if (capacity <= this->capacity) {
+        return true;
+    }
+    Unmap();
+    this->capacity = capacity;
+    return Map();
+}
+
+void MappedFile::Flush() {
+    if (data) {
+        FlushViewOfFile(data, 0);
+    }
+}
+
+void MappedFile::Close(uint64_t length) {
+    Unmap();
+    if (file != INVALID_HANDLE_VALUE) {
+        LARGE_INTEGER size;
+        size.QuadPart = static_cast<long long>(length);
+        if (!shared && SetFilePointerEx(file, size, NULL, FILE_BEGIN)) {
+            SetEndOfFile(file);
+        }
+        CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+    }
+    capacity = 0;
+}
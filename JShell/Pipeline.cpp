@@ -2,64 +2,107 @@
 #include "Pipeline.hpp"
 #include "JavaAPI.hpp"
 #include <iostream>
+#include <sstream>
+#include <stdexcept>
 
-Pipeline::Pipeline(const std::wstring& pipeName, size_t bufferSize)
-    : pipeName(pipeName), bufferSize(bufferSize), hPipe(INVALID_HANDLE_VALUE) {
+namespace {
+    long long ElapsedMillis(std::chrono::steady_clock::time_point since) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - since).count();
+    }
+
+    std::string UnknownPriority(const std::string& instruction) {
+        return ErrorInfo(ErrorCode::BadRequest, "Unknown priority " + instruction.substr(0, instruction.find('>') + 1)).Format();
+    }
+}
+
+Pipeline::Pipeline(const std::string& endpoint, size_t bufferSize)
+    : listener(endpoint, bufferSize), endpoint(endpoint), bufferSize(bufferSize), session(0), inFlight(0), outboundClosed(false) {
 	running = false;
 }
 
-JavaAPI Pipeline::javaAPI;
+Scheduler Pipeline::scheduler;
+Recorder Pipeline::recorder;
+FrameCapture Pipeline::capture;
+EndpointRegistry Pipeline::registry;
+std::atomic<uint32_t> Pipeline::nextSession(1);
+std::atomic<uint32_t> Pipeline::connectedClients(0);
 
 Pipeline::~Pipeline() {
     DisconnectAndClose();
 }
 
 void Pipeline::StartServer() {
-    hPipe = CreateNamedPipe(
-        pipeName.c_str(),
-        PIPE_ACCESS_DUPLEX,
-        PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT,
-        PIPE_UNLIMITED_INSTANCES,
-        static_cast<DWORD>(bufferSize),
-        static_cast<DWORD>(bufferSize),
-        0,
-        NULL);
-
-    if (hPipe == INVALID_HANDLE_VALUE) {
-        DWORD error = GetLastError();
-        LPVOID lpMsgBuf = nullptr;
-
-        FormatMessage(
-            FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM,
-            NULL,
-            error,
-            0, // Default language
-            (LPWSTR)&lpMsgBuf,
-            0,
-            NULL
-        );
-
-        // Display the error message in a message box
-        MessageBox(NULL, (LPCTSTR)lpMsgBuf, L"Error", MB_OK | MB_ICONERROR);
-
-        LocalFree(lpMsgBuf);
-        throw std::runtime_error("Failed to create named pipe.");
-    }
-    else running = true;
+    if (!listener.Open()) {
+        throw std::runtime_error("Failed to open " + endpoint);
+    }
+    running = true;
+}
+
+void Pipeline::Stop() {
+    running = false;
+    listener.Close();
+}
+
+bool Pipeline::ReadExact(char* data, size_t size) {
+    while (size > 0) {
+        size_t transferred = 0;
+        if (!connection->Read(data, size, transferred) || transferred == 0) {
+            return false;
+        }
+        data += transferred;
+        size -= transferred;
+    }
+    return true;
+}
+
+bool Pipeline::WriteAll(const char* data, size_t size) {
+    while (size > 0) {
+        size_t transferred = 0;
+        if (!connection->Write(data, size, transferred) || transferred == 0) {
+            return false;
+        }
+        data += transferred;
+        size -= transferred;
+    }
+    return true;
+}
+
+bool Pipeline::ReadFrame(FrameHeader& header, std::string& payload) {
+    std::lock_guard<std::mutex> lock(readMtx);
+    if (!ReadExact(reinterpret_cast<char*>(&header), sizeof(header))) {
+        return false;
+    }
+    if (header.length > MaxFrameLength) {
+        std::cerr << "Frame of " << header.length << " bytes exceeds the limit." << std::endl;
+        return false;
+    }
+
+    payload.resize(header.length);
+    return header.length == 0 || ReadExact(&payload[0], header.length);
+}
+
+bool Pipeline::WriteFrame(uint32_t id, uint32_t flags, const std::string& payload) {
+    std::lock_guard<std::mutex> lock(writeMtx);
+    FrameHeader header = { static_cast<uint32_t>(payload.size()), id, flags };
+
+    // One write per frame keeps the header and payload in a single pipe message. The buffer
+    // keeps its capacity, so steady traffic costs no allocation per response.
+    frameBuffer.assign(reinterpret_cast<const char*>(&header), sizeof(header));
+    frameBuffer += payload;
+    return WriteAll(frameBuffer.data(), frameBuffer.size());
 }
 
-bool Pipeline::ReadFromPipe(std::vector<char>& buffer, DWORD& bytesRead) {
-    std::lock_guard<std::mutex> lock(mtx);
+bool Pipeline::ReadFromPipe(std::vector<char>& buffer, size_t& bytesRead) {
+    std::lock_guard<std::mutex> lock(readMtx);
     const std::string terminator = "<END>";
     std::vector<char> tempBuffer(bufferSize, 0); // temporary buffer for each read
     buffer.clear(); // clear the main buffer
     bytesRead = 0;
 
     while (true) {
-        DWORD tempBytesRead = 0;
-        if (!::ReadFile(hPipe, tempBuffer.data(), static_cast<DWORD>(tempBuffer.size() - 1), &tempBytesRead, NULL)) {
-            DWORD error = GetLastError();
-            std::wcerr << L"Failed to read from pipe. Error Code: " << error << std::endl;
+        size_t tempBytesRead = 0;
+        if (!connection->Read(tempBuffer.data(), tempBuffer.size() - 1, tempBytesRead)) {
+            std::cerr << "Failed to read from pipe. Error Code: " << LastErrorCode() << std::endl;
             return false;
         }
 
@@ -71,7 +114,7 @@ bool Pipeline::ReadFromPipe(std::vector<char>& buffer, DWORD& bytesRead) {
         if (buffer.size() >= terminator.size() && std::string(buffer.end() - terminator.size(), buffer.end()) == terminator) {
             // Remove the terminator from the buffer
             buffer.erase(buffer.end() - terminator.size(), buffer.end());
-            bytesRead -= static_cast<DWORD>(terminator.size());
+            bytesRead -= terminator.size();
             return true;
         }
 
@@ -86,53 +129,49 @@ bool Pipeline::ReadFromPipe(std::vector<char>& buffer, DWORD& bytesRead) {
 
 
 bool Pipeline::WriteResponse(const std::string& response) {
-    std::lock_guard<std::mutex> lock(mtx);
-    DWORD bytesWritten;
-    if (!::WriteFile(hPipe, response.c_str(), static_cast<DWORD>(response.size()), &bytesWritten, NULL)) {
+    std::lock_guard<std::mutex> lock(writeMtx);
+    if (!WriteAll(response.c_str(), response.size())) {
         std::cout << "Failed to write to pipe" << std::endl;
         return false;
     }
-    FlushFileBuffers(hPipe);  // flush the pipe
+    connection->Flush();  // flush the pipe
     return true;
 }
 
 void Pipeline::DisconnectAndClose() {
-    if (hPipe != INVALID_HANDLE_VALUE) {
-        DisconnectNamedPipe(hPipe);
-        CloseHandle(hPipe);
-        hPipe = INVALID_HANDLE_VALUE;
+    if (connection) {
+        connection->Close();
+        connection.reset();
         running = false;
     }
 }
 
-bool Pipeline::ReadFromPipeWithTimeout(std::vector<char>& buffer, DWORD& bytesRead, DWORD timeoutMillis) {
+bool Pipeline::ReadFromPipeWithTimeout(std::vector<char>& buffer, size_t& bytesRead, uint32_t timeoutMillis) {
     const std::string terminator = "<END>";
 
-    std::lock_guard<std::mutex> lock(mtx);
+    std::lock_guard<std::mutex> lock(readMtx);
     buffer.clear();
 
-    ULONGLONG startTime = GetTickCount64();
-    ULONGLONG elapsedTime = 0;
+    auto startTime = std::chrono::steady_clock::now();
+    long long elapsedTime = 0;
     bytesRead = 0;
 
     while (elapsedTime < timeoutMillis) {
-        DWORD bytesAvailable = 0;
-        if (!::PeekNamedPipe(hPipe, NULL, 0, NULL, &bytesAvailable, NULL)) {
-            DWORD error = GetLastError();
-            std::wcerr << L"Failed to peek named pipe. Error Code: " << error << std::endl;
-            Sleep(10);  // wait for a short interval before retrying
-            elapsedTime = GetTickCount64() - startTime;
+        size_t bytesAvailable = 0;
+        if (!connection->Available(bytesAvailable)) {
+            std::cerr << "Failed to peek named pipe. Error Code: " << LastErrorCode() << std::endl;
+            SleepMillis(10);  // wait for a short interval before retrying
+            elapsedTime = ElapsedMillis(startTime);
             continue;
         }
 
         if (bytesAvailable > 0) {
             std::vector<char> readBuffer(bytesAvailable + 1);
-            DWORD currentBytesRead = 0;
-            if (!::ReadFile(hPipe, readBuffer.data(), bytesAvailable, &currentBytesRead, NULL)) {
-                DWORD error = GetLastError();
-                std::wcerr << L"Failed to read from timeout pipe. Error Code: " << error << std::endl;
-                Sleep(10);  // wait for a short interval before retrying
-                elapsedTime = GetTickCount64() - startTime;
+            size_t currentBytesRead = 0;
+            if (!connection->Read(readBuffer.data(), bytesAvailable, currentBytesRead)) {
+                std::cerr << "Failed to read from timeout pipe. Error Code: " << LastErrorCode() << std::endl;
+                SleepMillis(10);  // wait for a short interval before retrying
+                elapsedTime = ElapsedMillis(startTime);
                 continue;
             }
 
@@ -163,31 +202,218 @@ bool Pipeline::ReadFromPipeWithTimeout(std::vector<char>& buffer, DWORD& bytesRe
             }
         }
 
-        Sleep(10);  // wait for a short interval before checking again
-        elapsedTime = GetTickCount64() - startTime;
+        SleepMillis(10);  // wait for a short interval before checking again
+        elapsedTime = ElapsedMillis(startTime);
     }
 
-    std::wcerr << L"Timeout or terminator not found." << std::endl;
+    std::cerr << "Timeout or terminator not found." << std::endl;
     return false;
 }
 
 
-DWORD WINAPI Pipeline::ClientThread(LPVOID lpParam) {
+bool Pipeline::HandleControl(const std::string& instruction, std::string& response) {
+    // Clients terminate everything with ';', commands included.
+    std::string command = instruction;
+    while (!command.empty() && (command.back() == ';' || command.back() == ' ')) {
+        command.pop_back();
+    }
+
+    if (command == "stats") {
+        response = scheduler.Stats() + recorder.Stats() + capture.Stats();
+        return true;
+    }
+    if (command.compare(0, 13, "record start ") == 0) {
+        response = recorder.Start(command.substr(13)) ? "recording" : "Failed to start recording";
+        return true;
+    }
+    if (command == "record stop") {
+        recorder.Stop();
+        response = "stopped";
+        return true;
+    }
+    if (command == "cache clear") {
+        scheduler.ClearCache();
+        response = "cleared";
+        return true;
+    }
+    if (command.compare(0, 14, "capture start ") == 0) {
+        std::string path;
+        AWTRectangle region;
+        response = FrameCapture::ParseArguments(command.substr(14), path, region) && capture.Start(path, region)
+            ? "capturing" : "Failed to start capture";
+        return true;
+    }
+    if (command == "capture stop") {
+        capture.Stop();
+        response = "stopped";
+        return true;
+    }
+    if (command.compare(0, 15, "scheduler mode ") == 0) {
+        std::string mode = command.substr(15);
+        if (mode == "strict" || mode == "weighted") {
+            scheduler.SetMode(mode == "strict" ? DispatchMode::Strict : DispatchMode::WeightedFair);
+            response = "mode " + mode;
+        }
+        else {
+            response = "Unknown dispatch mode " + mode;
+        }
+        return true;
+    }
+    if (command.compare(0, 17, "scheduler weight ") == 0) {
+        // The tick lane is served once per tick, not by weight.
+        std::string lane;
+        int weight = 0;
+        Priority priority;
+        std::istringstream in(command.substr(17));
+        if (in >> lane >> weight && (in >> std::ws).eof() && weight > 0
+            && Scheduler::PriorityFromName(lane, priority) && priority != Priority::Tick) {
+            scheduler.SetWeight(priority, static_cast<unsigned int>(weight));
+            response = std::string("weight ") + Scheduler::PriorityName(priority) + " " + std::to_string(weight);
+        }
+        else {
+            response = "Usage: scheduler weight interactive|bulk <weight>";
+        }
+        return true;
+    }
+    return false;
+}
+
+void Pipeline::ServeLegacy() {
+    std::vector<char> buffer;
+    size_t bytesRead;
+    std::string instruction;
+    std::string response;
+
+    // Continue reading instructions from the client until the client disconnects or an error occurs
+    while (running) {
+        if (ReadFromPipe(buffer, bytesRead)) {
+            instruction.assign(buffer.begin(), buffer.begin() + bytesRead);
+            std::cout << "Received instruction: " << instruction << std::endl;
+
+            if (!HandleControl(instruction, response)) {
+                Priority priority;
+                if (!Scheduler::ParsePriority(instruction, priority)) {
+                    response = UnknownPriority(instruction);
+                }
+                else {
+                    auto arrival = std::chrono::steady_clock::now();
+                    response = scheduler.Submit(instruction, priority, session).get();
+                    recorder.Append(session, 0, priority, arrival, std::chrono::steady_clock::now(), instruction, response);
+                }
+            }
+
+            response += "<END>";
+
+            std::cout << "Sending response: " << response << std::endl;
+            WriteResponse(response);
+        }
+        else {
+            break;  // break out if reading from the pipe fails, which implies client has disconnected.
+        }
+    }
+}
+
+void Pipeline::QueueFrame(uint32_t id, uint32_t flags, const std::string& payload) {
+    {
+        std::lock_guard<std::mutex> lock(outboundMtx);
+        outbound.push_back(OutboundFrame{ id, flags, payload });
+    }
+    outboundCv.notify_one();
+}
+
+ThreadResult THREADCALL Pipeline::WriteFrames(void* lpParam) {
+    Pipeline* pipeline = static_cast<Pipeline*>(lpParam);
+    bool connected = true;
+    std::unique_lock<std::mutex> lock(pipeline->outboundMtx);
+    while (true) {
+        pipeline->outboundCv.wait(lock, [pipeline] { return !pipeline->outbound.empty() || pipeline->outboundClosed; });
+        if (pipeline->outbound.empty()) {
+            break;
+        }
+        OutboundFrame frame = std::move(pipeline->outbound.front());
+        pipeline->outbound.pop_front();
+        lock.unlock();
+        // Once a write fails the client is gone; the rest is dropped, the reader notices too.
+        connected = connected && pipeline->WriteFrame(frame.id, frame.flags, frame.payload);
+        lock.lock();
+    }
+    return 0;
+}
+
+void Pipeline::ServeFramed() {
+    FrameHeader header;
+    std::string instruction;
+    std::string response;
+
+    ThreadHandle writer;
+    if (!StartThread(WriteFrames, this, &writer)) {
+        std::cerr << "Failed to start the response writer." << std::endl;
+        return;
+    }
+
+    // Requests are handed to the scheduler without waiting, so one connection can keep
+    // many in flight; each response is queued for the writer thread when it is ready.
+    while (running && ReadFrame(header, instruction)) {
+        uint32_t id = header.id;
+
+        if (HandleControl(instruction, response)) {
+            QueueFrame(id, 0, response);
+            continue;
+        }
+        Priority priority;
+        if (!Scheduler::ParsePriority(instruction, priority)) {
+            QueueFrame(id, FrameFlagError, UnknownPriority(instruction));
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(inFlightMtx);
+            inFlight++;
+        }
+        auto arrival = std::chrono::steady_clock::now();
+        // The instruction is only kept for the callback when it is going to be recorded.
+        std::string recorded = recorder.IsRecording() ? instruction : std::string();
+        scheduler.Submit(instruction, priority, session, [this, id, priority, arrival, recorded](const std::string& response) {
+            QueueFrame(id, ErrorInfo::IsError(response) ? FrameFlagError : 0, response);
+            if (!recorded.empty()) {
+                recorder.Append(session, id, priority, arrival, std::chrono::steady_clock::now(), recorded, response);
+            }
+            std::lock_guard<std::mutex> lock(inFlightMtx);
+            inFlight--;
+            inFlightCv.notify_all();
+        });
+    }
+
+    // The completion callbacks reference this connection; wait for them before it is deleted.
+    {
+        std::unique_lock<std::mutex> lock(inFlightMtx);
+        inFlightCv.wait(lock, [this] { return inFlight == 0; });
+    }
+    {
+        std::lock_guard<std::mutex> lock(outboundMtx);
+        outboundClosed = true;
+    }
+    outboundCv.notify_one();
+    JoinThread(writer);
+}
+
+ThreadResult THREADCALL Pipeline::ClientThread(void* lpParam) {
+    // Each client thread owns its own connection instance and deletes it on exit.
     Pipeline* pipeline = static_cast<Pipeline*>(lpParam);
-    JavaAPI javaAPI;
+    connectedClients++;
     std::vector<char> buffer;
-    DWORD bytesRead;
+    size_t bytesRead;
     int handshakeRetries = 3;
-    std::string instruction;
+    bool framed = false;
     std::string handshakeMessage;
-    std::string response;
 
     while (handshakeRetries > 0) {
         if (pipeline->ReadFromPipeWithTimeout(buffer, bytesRead, 1000 /*timeout in ms*/)) {
             handshakeMessage.assign(buffer.begin(), buffer.begin() + bytesRead);
-            if (handshakeMessage == "READY") {
+            if (handshakeMessage == "READY" || handshakeMessage == "READY_FRAMED") {
                 std::cout << "Received handshake request." << std::endl;
-                pipeline->WriteResponse("GO_AHEAD<END>");
+                framed = handshakeMessage == "READY_FRAMED";
+                pipeline->WriteResponse(framed ? "GO_AHEAD_FRAMED<END>" : "GO_AHEAD<END>");
                 std::cout << "Sent handshake acknowledgment." << std::endl;
 
                 break; // break out of handshake loop
@@ -198,65 +424,75 @@ DWORD WINAPI Pipeline::ClientThread(LPVOID lpParam) {
 
     if (handshakeRetries <= 0) {
         std::cerr << "Failed to establish handshake after 3 retries." << std::endl;
-        pipeline->DisconnectAndClose();
+        delete pipeline;
+        connectedClients--;
         return 1; // Error code
     }
 
-    // Now, continue reading instructions from the client until the client disconnects or an error occurs
-    while (pipeline->running) {
-        Sleep(10);
-        if (pipeline->ReadFromPipe(buffer, bytesRead)) {
-            instruction.assign(buffer.begin(), buffer.begin() + bytesRead);
-            std::cout << "Received instruction: " << instruction << std::endl;
-            response = javaAPI.ProcessInstruction(instruction);
+    if (framed) {
+        pipeline->ServeFramed();
+    }
+    else {
+        pipeline->ServeLegacy();
+    }
 
-            response += "<END>";
+    // Free whatever handles the client left behind.
+    scheduler.Submit("release session", Priority::Bulk, pipeline->session, [](const std::string&) {});
+    delete pipeline;
+    connectedClients--;
+    return 0;
+}
 
-            std::cout << "Sending response: " << response << std::endl;
-            pipeline->WriteResponse(response);
-            
-            Sleep(10);
-        }
-        else {
-            break;  // break out if reading from the pipe fails, which implies client has disconnected.
-        }
+ThreadResult THREADCALL Pipeline::PublishLoad(void* lpParam) {
+    Pipeline* pipeline = static_cast<Pipeline*>(lpParam);
+    while (pipeline->running) {
+        registry.Publish(connectedClients, static_cast<uint32_t>(scheduler.Queued()), scheduler.Dispatched());
+        SleepMillis(EndpointRegistry::HeartbeatMillis);
     }
-    pipeline->DisconnectAndClose();
-    pipeline->StartServer();
     return 0;
 }
 
-DWORD WINAPI Pipeline::RunServer(LPVOID lpParam) {
+ThreadResult THREADCALL Pipeline::RunServer(void* lpParam) {
     Pipeline* pipeline = static_cast<Pipeline*>(lpParam);
+    scheduler.Start();
+    // Other clients on this machine serve their own endpoints; the registry is how a
+    // controller finds all of them.
+    registry.Register(pipeline->endpoint);
     pipeline->StartServer();
+    registry.SetStatus(EndpointStatus::Ready);
+    ThreadHandle publisher;
+    bool publishing = StartThread(PublishLoad, pipeline, &publisher);
 
-    // Main server loop. Wait for a connection, handle it, then wait for the next one.
+    // Main server loop. Wait for a connection and hand it to its own client thread while
+    // the listener keeps accepting. Requests from all connected clients meet in the
+    // scheduler, which decides evaluation order.
     while (pipeline->running) {
         std::cout << "Waiting for a connection..." << std::endl;
-        BOOL connected = ConnectNamedPipe(pipeline->hPipe, NULL);
-        if (!connected) {
-            if (GetLastError() == ERROR_PIPE_CONNECTED) {
-                connected = TRUE;
-            }
-            else {
-                pipeline->DisconnectAndClose();  // Close the current pipe handle
-                pipeline->StartServer();        // Recreate the pipe
-                continue;                       // Try to connect again
+        Connection* client = pipeline->listener.Accept();
+        if (!client) {
+            if (pipeline->running) {
+                SleepMillis(10);  // back off before retrying a failed accept
             }
+            continue;
         }
 
-        if (connected) {
-            std::cout << "Attempting handshake..." << std::endl;
-            // Create a new thread to handle the client's requests.
-            HANDLE hThread = CreateThread(NULL, 0, ClientThread, pipeline, 0, NULL);
-            if (hThread) {
-                // Wait for the client thread to finish. This ensures we handle one client at a time.
-                WaitForSingleObject(hThread, INFINITE);
-                pipeline->DisconnectAndClose();
-                pipeline->StartServer();
-            }
+        std::cout << "Attempting handshake..." << std::endl;
+        Pipeline* connection = new Pipeline(pipeline->endpoint, pipeline->bufferSize);
+        connection->connection.reset(client);
+        connection->running = true;
+        connection->session = nextSession++;
+
+        if (!StartThread(ClientThread, connection)) {
+            delete connection;
         }
     }
 
+    registry.SetStatus(EndpointStatus::Stopping);
+    if (publishing) {
+        JoinThread(publisher);
+    }
+    capture.Stop();
+    scheduler.Stop();
+    registry.Unregister();
     return 0;
-}
\ No newline at end of file
+}
@@ -1,28 +1,97 @@
+#pragma once
 #include "pch.h"
 #include <string>
 #include <vector>
-#include <Windows.h>
+#include <deque>
+#include <memory>
 #include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <atomic>
 #include "JavaAPI.hpp"
+#include "Scheduler.hpp"
+#include "Recorder.hpp"
+#include "FrameCapture.hpp"
+#include "Transport.hpp"
+#include "EndpointRegistry.hpp"
+
+// Header of a framed message. Clients that open with the "READY_FRAMED" handshake exchange
+// these instead of "<END>"-terminated text, which lets several requests be in flight on one
+// connection: responses carry the id of their request and may arrive out of order.
+// All fields are little-endian; the payload of `length` bytes follows immediately.
+struct FrameHeader {
+    uint32_t length;
+    uint32_t id;
+    uint32_t flags;
+};
+
+const uint32_t MaxFrameLength = 64 * 1024 * 1024;
+
+// Set on a response frame whose payload is an error (see Errors.hpp) rather than a value.
+const uint32_t FrameFlagError = 0x1;
 
 class Pipeline {
 public:
-    Pipeline(const std::wstring& pipeName, size_t bufferSize);
+    Pipeline(const std::string& endpoint, size_t bufferSize);
     ~Pipeline();
     bool running;
     void StartServer();
-    static DWORD WINAPI RunServer(LPVOID lpParam);
-    static DWORD WINAPI ClientThread(LPVOID lpParam);
-    bool ReadFromPipeWithTimeout(std::vector<char>& buffer, DWORD& bytesRead, DWORD timeoutMillis);
-    bool ReadFromPipe(std::vector<char>& buffer, DWORD& bytesRead);
+    // Stops accepting clients; RunServer returns once the listener has closed.
+    void Stop();
+    static ThreadResult THREADCALL RunServer(void* lpParam);
+    static ThreadResult THREADCALL ClientThread(void* lpParam);
+    // Keeps this server's registry slot current until the server stops.
+    static ThreadResult THREADCALL PublishLoad(void* lpParam);
+    bool ReadFromPipeWithTimeout(std::vector<char>& buffer, size_t& bytesRead, uint32_t timeoutMillis);
+    bool ReadFromPipe(std::vector<char>& buffer, size_t& bytesRead);
     bool WriteResponse(const std::string& response);
+    bool ReadFrame(FrameHeader& header, std::string& payload);
+    bool WriteFrame(uint32_t id, uint32_t flags, const std::string& payload);
     void DisconnectAndClose();
 
 private:
-    HANDLE hPipe;
-    std::wstring pipeName;
+    bool ReadExact(char* data, size_t size);
+    bool WriteAll(const char* data, size_t size);
+    // Answers server-level commands (stats, record, cache, capture, scheduler) without going through the scheduler.
+    static bool HandleControl(const std::string& instruction, std::string& response);
+    void ServeLegacy();
+    void ServeFramed();
+    // Hands a framed response to this connection's writer thread.
+    void QueueFrame(uint32_t id, uint32_t flags, const std::string& payload);
+    static ThreadResult THREADCALL WriteFrames(void* lpParam);
+
+    Listener listener;                      // used by the accepting instance
+    std::unique_ptr<Connection> connection; // used by the per-client instances
+    std::string endpoint;
     size_t bufferSize;
-    static JavaAPI javaAPI;
-    std::mutex mtx; // Mutex for thread-safety
-    
+    uint32_t session; // identifies this connection's handles to the evaluator
+    static std::atomic<uint32_t> nextSession;
+    static Scheduler scheduler; // Shared by every connection, owns the evaluator thread
+    static Recorder recorder;   // Wire-traffic log, off until "record start <path>"
+    static FrameCapture capture; // Off until "capture start [x y width height] <path>"
+    static EndpointRegistry registry;
+    static std::atomic<uint32_t> connectedClients;
+    // Connections are read and written concurrently, so a reader blocked on the next frame
+    // does not stall a writer delivering a response; each direction has its own lock.
+    std::mutex readMtx;
+    std::mutex writeMtx;
+    std::string frameBuffer; // guarded by writeMtx
+
+    // Framed requests submitted to the scheduler and not yet answered.
+    std::mutex inFlightMtx;
+    std::condition_variable inFlightCv;
+    size_t inFlight;
+
+    // Framed responses waiting for the writer thread. Completion callbacks run on the shared
+    // evaluator thread and only queue here, so a client that stops reading stalls its own
+    // writer and no one else's requests.
+    struct OutboundFrame {
+        uint32_t id;
+        uint32_t flags;
+        std::string payload;
+    };
+    std::mutex outboundMtx;
+    std::condition_variable outboundCv;
+    std::deque<OutboundFrame> outbound;
+    bool outboundClosed; // no more frames will be queued
 };
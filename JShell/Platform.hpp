@@ -0,0 +1,47 @@
+#pragma once
+#include "pch.h"
+#include <string>
+#include <cstdint>
+
+// The few OS services the server core needs. Everything above this header (transport
+// framing, scheduler, evaluator, JNI cache) is portable; the definitions live in
+// PlatformWin32.cpp for the injected DLL and PlatformPosix.cpp for the Linux host.
+#ifdef _WIN32
+typedef HANDLE NativeHandle;   // pipe or file handle
+typedef HANDLE ThreadHandle;
+typedef DWORD ThreadResult;
+#define THREADCALL WINAPI
+#else
+#include <pthread.h>
+typedef int NativeHandle;      // socket or file descriptor
+typedef pthread_t ThreadHandle;
+typedef uint32_t ThreadResult;
+#define THREADCALL
+#endif
+
+typedef ThreadResult(THREADCALL* ThreadProc)(void* param);
+
+// Starts proc(param) on a new thread. When `handle` is given the thread has to be joined
+// with JoinThread, otherwise it is detached.
+bool StartThread(ThreadProc proc, void* param, ThreadHandle* handle = nullptr);
+void JoinThread(ThreadHandle handle);
+void SleepMillis(uint32_t millis);
+
+// GetLastError() / errno of the last failed call, for log messages.
+int LastErrorCode();
+
+uint32_t CurrentProcessId();
+// False once the process has exited. Used to reclaim registry slots of servers that died.
+bool ProcessAlive(uint32_t pid);
+// Directory for files shared by the processes on this machine, with a trailing separator.
+std::string TempDirectory();
+// The variable's value, or an empty string if it is not set.
+std::string EnvironmentVariable(const char* name);
+
+// Where the server listens: JSHELL_ENDPOINT if set, otherwise a named pipe on Windows or a
+// Unix domain socket elsewhere, named after the process so that every client on a machine
+// gets its own ("jshellpipe-<pid>"). Clients find them through EndpointRegistry.hpp.
+std::string DefaultEndpoint();
+
+// Reports a failure to the user: a message box inside the game client, stderr on the host.
+void DisplayErrorMessage(const std::string& message);
@@ -0,0 +1,91 @@
+#include "pch.h"
+#include "Platform.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+    struct ThreadStart {
+        ThreadProc proc;
+        void* param;
+    };
+
+    void* RunThread(void* param) {
+        ThreadStart* start = static_cast<ThreadStart*>(param);
+        ThreadProc proc = start->proc;
+        void* procParam = start->param;
+        delete start;
+        proc(procParam);
+        return nullptr;
+    }
+}
+
+bool StartThread(ThreadProc proc, void* param, ThreadHandle* handle) {
+    ThreadStart* start = new ThreadStart{ proc, param };
+    pthread_t thread;
+    if (pthread_create(&thread, nullptr, RunThread, start) != 0) {
+        delete start;
+        return false;
+    }
+    if (handle) {
+        *handle = thread;
+    }
+    else {
+        pthread_detach(thread);
+    }
+    return true;
+}
+
+void JoinThread(ThreadHandle handle) {
+    pthread_join(handle, nullptr);
+}
+
+void SleepMillis(uint32_t millis) {
+    timespec duration = { static_cast<time_t>(millis / 1000), static_cast<long>(millis % 1000) * 1000000L };
+    while (nanosleep(&duration, &duration) != 0 && errno == EINTR) {
+    }
+}
+
+int LastErrorCode() {
+    return errno;
+}
+
+uint32_t CurrentProcessId() {
+    return static_cast<uint32_t>(getpid());
+}
+
+bool ProcessAlive(uint32_t pid) {
+    // EPERM: the process exists but belongs to another user.
+    return kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM;
+}
+
+std::string TempDirectory() {
+    std::string directory = EnvironmentVariable("TMPDIR");
+    if (directory.empty()) {
+        return "/tmp/";
+    }
+    if (directory.back() != '/') {
+        directory += '/';
+    }
+    return directory;
+}
+
+std::string EnvironmentVariable(const char* name) {
+    const char* value = getenv(name);
+    return value ? std::string(value) : std::string();
+}
+
+std::string DefaultEndpoint() {
+    std::string configured = EnvironmentVariable("JSHELL_ENDPOINT");
+    if (!configured.empty()) {
+        return configured;
+    }
+    return "/tmp/jshellpipe-" + std::to_string(CurrentProcessId()) + ".sock";
+}
+
+void DisplayErrorMessage(const std::string& message) {
+    std::cerr << "Error: " << message << std::endl;
+}
@@ -0,0 +1,74 @@
+#include "pch.h"
+#include "Platform.hpp"
+
+bool StartThread(ThreadProc proc, void* param, ThreadHandle* handle) {
+    HANDLE thread = CreateThread(NULL, 0, proc, param, 0, NULL);
+    if (!thread) {
+        return false;
+    }
+    if (handle) {
+        *handle = thread;
+    }
+    else {
+        CloseHandle(thread);
+    }
+    return true;
+}
+
+void JoinThread(ThreadHandle handle) {
+    WaitForSingleObject(handle, INFINITE);
+    CloseHandle(handle);
+}
+
+void SleepMillis(uint32_t millis) {
+    Sleep(millis);
+}
+
+int LastErrorCode() {
+    return static_cast<int>(GetLastError());
+}
+
+uint32_t CurrentProcessId() {
+    return static_cast<uint32_t>(GetCurrentProcessId());
+}
+
+bool ProcessAlive(uint32_t pid) {
+    HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, pid);
+    if (!process) {
+        // Access is denied to processes of other users, which are still running.
+        return GetLastError() == ERROR_ACCESS_DENIED;
+    }
+    bool alive = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+    CloseHandle(process);
+    return alive;
+}
+
+std::string TempDirectory() {
+    char path[MAX_PATH + 1];
+    DWORD length = GetTempPathA(sizeof(path), path);
+    if (length == 0 || length > MAX_PATH) {
+        return ".\\";
+    }
+    return std::string(path, length);
+}
+
+std::string EnvironmentVariable(const char* name) {
+    char value[1024];
+    DWORD length = GetEnvironmentVariableA(name, value, sizeof(value));
+    if (length == 0 || length >= sizeof(value)) {
+        return std::string();
+    }
+    return std::string(value, length);
+}
+
+std::string DefaultEndpoint() {
+    std::string configured = EnvironmentVariable("JSHELL_ENDPOINT");
+    if (!configured.empty()) {
+        return configured;
+    }
+    return "\\\\.\\pipe\\jshellpipe-" + std::to_string(CurrentProcessId());
+}
+
+void DisplayErrorMessage(const std::string& message) {
+    MessageBoxA(NULL, message.c_str(), "Error", MB_OK | MB_ICONERROR);
+}
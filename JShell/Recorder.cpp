@@ -0,0 +1,108 @@
+#include "pch.h"
+#include "Recorder.hpp"
+#include <atomic>
+#include <cstring>
+#include <sstream>
+#include <iostream>
+
+Recorder::Recorder()
+    : recording(false), length(0), records(0) {
+}
+
+Recorder::~Recorder() {
+    Stop();
+}
+
+bool Recorder::Start(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (recording) {
+        return false;
+    }
+    if (!file.Open(path, InitialCapacity)) {
+        std::cerr << "Failed to open recording " << path << std::endl;
+        return false;
+    }
+
+    RecordLogHeader header = {};
+    memcpy(header.magic, "JSRL", 4);
+    header.version = Version;
+    header.length = sizeof(RecordLogHeader);
+    header.startMicros = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    memcpy(file.Data(), &header, sizeof(header));
+
+    start = std::chrono::steady_clock::now();
+    length = sizeof(RecordLogHeader);
+    records = 0;
+    recording = true;
+    return true;
+}
+
+void Recorder::Stop() {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!recording) {
+        return;
+    }
+    recording = false;
+    file.Close(length);
+}
+
+void Recorder::Append(uint32_t session, uint32_t requestId, Priority priority,
+    std::chrono::steady_clock::time_point arrival, std::chrono::steady_clock::time_point completed,
+    const std::string& request, const std::string& response) {
+    if (!recording) {
+        return;
+    }
+
+    RecordHeader record = {};
+    record.length = static_cast<uint32_t>(sizeof(RecordHeader) + request.size() + response.size());
+    record.session = session;
+    record.requestId = requestId;
+    record.priority = static_cast<uint8_t>(priority);
+    record.requestLength = static_cast<uint32_t>(request.size());
+    record.responseLength = static_cast<uint32_t>(response.size());
+    record.latencyMicros = static_cast<uint32_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(completed - arrival).count());
+
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!recording) {
+        return;
+    }
+    record.arrivalMicros = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(arrival - start).count());
+
+    if (length + record.length > file.Capacity()) {
+        uint64_t capacity = file.Capacity();
+        while (length + record.length > capacity) {
+            capacity *= 2;
+        }
+        if (!file.Grow(capacity)) {
+            std::cerr << "Failed to grow recording, stopping." << std::endl;
+            recording = false;
+            file.Close(length);
+            return;
+        }
+    }
+
+    char* out = file.Data() + length;
+    memcpy(out, &record, sizeof(record));
+    memcpy(out + sizeof(record), request.data(), request.size());
+    memcpy(out + sizeof(record) + request.size(), response.data(), response.size());
+    length += record.length;
+    records++;
+
+    // Publish the new length last so a concurrent reader never sees a partial record; the
+    // fence keeps the record's bytes from becoming visible after the length.
+    std::atomic_thread_fence(std::memory_order_release);
+    reinterpret_cast<RecordLogHeader*>(file.Data())->length = length;
+}
+
+std::string Recorder::Stats() {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::ostringstream out;
+    out << "recorder active=" << (recording ? 1 : 0)
+        << " records=" << records
+        << " bytes=" << length
+        << "\n";
+    return out.str();
+}
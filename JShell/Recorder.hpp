@@ -0,0 +1,63 @@
+#pragma once
+#include "pch.h"
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "MappedFile.hpp"
+#include "Scheduler.hpp"
+
+// On-disk layout of a wire-traffic recording (little-endian, packed). The file starts with
+// a RecordLogHeader; `length` is the number of valid bytes, so a reader can consume a log
+// that is still being written. Each record is a RecordHeader followed by the request and
+// then the response bytes. replay.py reads the same layout.
+#pragma pack(push, 1)
+struct RecordLogHeader {
+    char magic[4];          // "JSRL"
+    uint32_t version;
+    uint64_t length;
+    uint64_t startMicros;   // wall clock at start, microseconds since the Unix epoch
+    uint8_t reserved[40];
+};
+
+struct RecordHeader {
+    uint32_t length;        // whole record, header included
+    uint32_t session;
+    uint32_t requestId;     // frame id, 0 on the legacy protocol
+    uint8_t priority;
+    uint8_t flags;
+    uint16_t reserved;
+    uint64_t arrivalMicros; // since the start of the recording
+    uint32_t latencyMicros; // arrival to response
+    uint32_t requestLength;
+    uint32_t responseLength;
+    uint32_t reserved2;
+};
+#pragma pack(pop)
+
+class Recorder {
+public:
+    static const uint32_t Version = 1;
+    static const uint64_t InitialCapacity = 16 * 1024 * 1024;
+
+    Recorder();
+    ~Recorder();
+
+    bool Start(const std::string& path);
+    void Stop();
+    bool IsRecording() const { return recording; }
+
+    void Append(uint32_t session, uint32_t requestId, Priority priority,
+        std::chrono::steady_clock::time_point arrival, std::chrono::steady_clock::time_point completed,
+        const std::string& request, const std::string& response);
+    std::string Stats();
+
+private:
+    MappedFile file;
+    std::mutex mtx;
+    std::atomic<bool> recording;
+    std::chrono::steady_clock::time_point start;
+    uint64_t length;
+    uint64_t records;
+};
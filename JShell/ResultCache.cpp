@@ -0,0 +1,176 @@
+#include "pch.h"
+#include "ResultCache.hpp"
+#include <cctype>
+#include <cstdlib>
+#include <iterator>
+#include <sstream>
+
+namespace {
+    // Per-entry overhead of the list node and the index, roughly.
+    const size_t EntryOverheadBytes = 96;
+}
+
+ResultCache::ResultCache(size_t capacityBytes)
+    : capacityBytes(capacityBytes), bytes(0), hits(0), misses(0), expirations(0), evictions(0) {
+}
+
+CachePolicy ResultCache::ParsePolicy(std::string& instruction) {
+    CachePolicy policy;
+    const std::string prefix = "<CACHE";
+    if (instruction.compare(0, prefix.size(), prefix) != 0) {
+        return policy;
+    }
+
+    size_t end = instruction.find('>', prefix.size());
+    if (end == std::string::npos) {
+        return policy;
+    }
+    std::string argument = instruction.substr(prefix.size(), end - prefix.size());
+    if (!argument.empty()) {
+        char* last = nullptr;
+        unsigned long millis = argument[0] == '=' ? strtoul(argument.c_str() + 1, &last, 10) : 0;
+        if (argument[0] != '=' || argument.size() == 1 || *last != '\0' || millis == 0) {
+            return policy;
+        }
+        policy.ttlMillis = static_cast<uint32_t>(millis);
+    }
+    instruction.erase(0, end + 1);
+    policy.enabled = true;
+    return policy;
+}
+
+std::string ResultCache::Key(const std::string& instruction, uint32_t session) {
+    std::string text = instruction;
+    while (!text.empty() && (text.back() == ';' || isspace(static_cast<unsigned char>(text.back())))) {
+        text.pop_back();
+    }
+    if (text.empty() || text == "cleanup" || text.compare(0, 8, "release ") == 0
+        || text.compare(0, 5, "<PIN>") == 0 || text.compare(0, 8, "<HANDLE>") == 0) {
+        return std::string();
+    }
+
+    // Handle ids carry a generation, so a key never outlives the object it names, but they
+    // only resolve in their own session.
+    std::string key;
+    if (text.find("$h{") != std::string::npos) {
+        key = "s" + std::to_string(session) + "\x1f";
+    }
+    const size_t start = key.size();
+    key.reserve(start + text.size());
+    char quote = 0;
+    bool space = false;
+    for (size_t i = 0; i < text.size(); i++) {
+        char c = text[i];
+        if (quote) {
+            key += c;
+            if (c == '\\' && i + 1 < text.size()) {
+                key += text[++i];
+            }
+            else if (c == quote) {
+                quote = 0;
+            }
+            continue;
+        }
+        if (isspace(static_cast<unsigned char>(c))) {
+            space = key.size() > start;
+            continue;
+        }
+        if (space) {
+            key += ' ';
+            space = false;
+        }
+        if (c == '"' || c == '\'') {
+            quote = c;
+        }
+        key += c;
+    }
+    return key;
+}
+
+bool ResultCache::Lookup(const std::string& key, int tick, std::chrono::steady_clock::time_point now, std::string& response) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto found = index.find(key);
+    if (found == index.end()) {
+        misses++;
+        return false;
+    }
+
+    EntryRef entry = found->second;
+    bool valid = now < entry->expires && (entry->tick < 0 || tick == entry->tick);
+    if (!valid) {
+        Erase(entry);
+        expirations++;
+        misses++;
+        return false;
+    }
+    entries.splice(entries.begin(), entries, entry);
+    response = entry->response;
+    hits++;
+    return true;
+}
+
+void ResultCache::Store(const std::string& key, const std::string& response, const CachePolicy& policy,
+    int tick, std::chrono::steady_clock::time_point now) {
+    // Without a tick counter there is nothing to scope a tick entry to.
+    if (!policy.enabled || key.empty() || (policy.ttlMillis == 0 && tick < 0)) {
+        return;
+    }
+    Entry entry;
+    entry.key = key;
+    entry.response = response;
+    entry.tick = policy.ttlMillis == 0 ? tick : -1;
+    uint32_t ttlMillis = policy.ttlMillis;
+    if (ttlMillis == 0) {
+        ttlMillis = TickMaxAgeMillis;
+    }
+    entry.expires = now + std::chrono::milliseconds(ttlMillis);
+    size_t footprint = Footprint(entry);
+    if (footprint > capacityBytes / 4) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mtx);
+    auto found = index.find(key);
+    if (found != index.end()) {
+        Erase(found->second);
+    }
+    while (bytes + footprint > capacityBytes && !entries.empty()) {
+        Erase(std::prev(entries.end()));
+        evictions++;
+    }
+    entries.push_front(std::move(entry));
+    index[key] = entries.begin();
+    bytes += footprint;
+}
+
+void ResultCache::Clear() {
+    std::lock_guard<std::mutex> lock(mtx);
+    entries.clear();
+    index.clear();
+    bytes = 0;
+}
+
+void ResultCache::Erase(EntryRef entry) {
+    bytes -= Footprint(*entry);
+    index.erase(entry->key);
+    entries.erase(entry);
+}
+
+size_t ResultCache::Footprint(const Entry& entry) {
+    // The key is held twice, by the entry and by the index.
+    return 2 * entry.key.size() + entry.response.size() + EntryOverheadBytes;
+}
+
+std::string ResultCache::Stats() {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::ostringstream out;
+    out << "cache entries=" << entries.size()
+        << " bytes=" << bytes
+        << " capacity=" << capacityBytes
+        << " hits=" << hits
+        << " misses=" << misses
+        << " expirations=" << expirations
+        << " evictions=" << evictions
+        << "\n";
+    return out.str();
+}
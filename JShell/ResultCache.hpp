@@ -0,0 +1,71 @@
+#pragma once
+#include "pch.h"
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+// Whether and for how long the result of a request may be reused. Requests opt in with a
+// "<CACHE>" prefix, valid until the game tick advances, or "<CACHE=<millis>>", valid for
+// that long. Only for side-effect-free reads: a cached result is answered without
+// evaluating the snippet again.
+struct CachePolicy {
+    bool enabled = false;
+    uint32_t ttlMillis = 0; // 0 = until the tick advances, at most TickMaxAgeMillis
+};
+
+// Results of opted-in requests, keyed by the normalized snippet text. Bounded by the bytes
+// held and evicted least recently used first. Used by the evaluator thread; Stats and
+// Clear may be called from any thread.
+class ResultCache {
+public:
+    static const size_t DefaultCapacityBytes = 8 * 1024 * 1024;
+    // Upper bound on the life of a tick-scoped entry, so a counter that stops advancing
+    // (the login screen, a stalled client) cannot keep serving the same result. Matches
+    // the scheduler's tick wait limit.
+    static const uint32_t TickMaxAgeMillis = 2000;
+
+    explicit ResultCache(size_t capacityBytes = DefaultCapacityBytes);
+
+    ResultCache(const ResultCache&) = delete;
+    void operator=(const ResultCache&) = delete;
+
+    // Strips an optional "<CACHE>" / "<CACHE=millis>" prefix from the instruction.
+    static CachePolicy ParsePolicy(std::string& instruction);
+    // The cache key of an instruction: its text with whitespace outside literals collapsed,
+    // and the session if it refers to handles. Empty for instructions that must always run
+    // (commands, pinned declarations, handle creation).
+    static std::string Key(const std::string& instruction, uint32_t session);
+
+    // `tick` is the client's tick counter now, -1 if unknown; tick-scoped entries are only
+    // valid in the tick they were stored in, and for at most TickMaxAgeMillis.
+    bool Lookup(const std::string& key, int tick, std::chrono::steady_clock::time_point now, std::string& response);
+    void Store(const std::string& key, const std::string& response, const CachePolicy& policy,
+        int tick, std::chrono::steady_clock::time_point now);
+    void Clear();
+    std::string Stats();
+
+private:
+    struct Entry {
+        std::string key;
+        std::string response;
+        int tick; // -1 for entries that expire by time only
+        std::chrono::steady_clock::time_point expires;
+    };
+    typedef std::list<Entry>::iterator EntryRef;
+
+    void Erase(EntryRef entry); // caller must hold mtx
+    static size_t Footprint(const Entry& entry);
+
+    std::mutex mtx;
+    std::list<Entry> entries; // most recently used first
+    std::unordered_map<std::string, EntryRef> index;
+    size_t capacityBytes;
+    size_t bytes;
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long expirations; // stale entries dropped on lookup
+    unsigned long long evictions;   // entries dropped to stay under the capacity
+};
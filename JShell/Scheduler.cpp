@@ -0,0 +1,409 @@
+#include "pch.h"
+#include "Scheduler.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <sstream>
+#include <iostream>
+
+void LaneStats::Record(unsigned long long waitMicros) {
+    dispatched++;
+    totalWaitMicros += waitMicros;
+    maxWaitMicros = (std::max)(maxWaitMicros, waitMicros);
+
+    if (samples.size() < SampleCount) {
+        samples.push_back(waitMicros);
+    }
+    else {
+        samples[nextSample] = waitMicros;
+    }
+    nextSample = (nextSample + 1) % SampleCount;
+}
+
+unsigned long long LaneStats::Percentile(double p) const {
+    if (samples.empty()) {
+        return 0;
+    }
+    std::vector<unsigned long long> sorted(samples);
+    size_t index = static_cast<size_t>(p * (sorted.size() - 1));
+    std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+    return sorted[index];
+}
+
+Scheduler::Scheduler(DispatchMode mode)
+    : mode(mode), tickRequests(0), tickFailures(0), tickArmed(false), armedTick(-1), running(false), evaluator(nullptr) {
+    // Interactive requests get four slots for every bulk slot when both lanes are busy.
+    weights[static_cast<size_t>(Priority::Interactive)] = 4;
+    weights[static_cast<size_t>(Priority::Bulk)] = 1;
+    weights[static_cast<size_t>(Priority::Tick)] = 1; // not weighted, see ServeTickLane
+    for (size_t i = 0; i < PriorityCount; i++) {
+        credits[i] = 0;
+    }
+}
+
+Scheduler::~Scheduler() {
+    Stop();
+}
+
+void Scheduler::Start() {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (running) {
+        return;
+    }
+    running = true;
+    if (!StartThread(RunEvaluator, this, &evaluatorThread)) {
+        running = false;
+        throw std::runtime_error("Failed to create evaluator thread.");
+    }
+}
+
+void Scheduler::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!running) {
+            return;
+        }
+        running = false;
+    }
+    cv.notify_all();
+
+    JoinThread(evaluatorThread);
+}
+
+std::future<std::string> Scheduler::Submit(const std::string& instruction, Priority priority, uint32_t session) {
+    auto response = std::make_shared<std::promise<std::string>>();
+    std::future<std::string> result = response->get_future();
+    Submit(instruction, priority, session, [response](const std::string& value) {
+        response->set_value(value);
+    });
+    return result;
+}
+
+void Scheduler::Submit(const std::string& instruction, Priority priority, uint32_t session, std::function<void(const std::string&)> complete) {
+    std::unique_ptr<Request> request(new Request());
+    request->instruction = instruction;
+    request->priority = priority;
+    request->session = session;
+    // Tick lane requests are read once per tick anyway and are not cached.
+    request->cache = ResultCache::ParsePolicy(request->instruction);
+    request->enqueued = std::chrono::steady_clock::now();
+    request->complete = std::move(complete);
+
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        // Once stopped, the evaluator has already failed what was queued and would never
+        // see this request; client threads still serving must not wait for it.
+        if (running) {
+            lanes[static_cast<size_t>(priority)].push_back(std::move(request));
+        }
+    }
+    if (request) {
+        request->complete(ErrorInfo(ErrorCode::Internal, "Server is shutting down").Format());
+        return;
+    }
+    cv.notify_one();
+}
+
+void Scheduler::SetMode(DispatchMode mode) {
+    std::lock_guard<std::mutex> lock(mtx);
+    this->mode = mode;
+}
+
+void Scheduler::SetWeight(Priority priority, unsigned int weight) {
+    std::lock_guard<std::mutex> lock(mtx);
+    weights[static_cast<size_t>(priority)] = (std::max)(weight, 1u);
+}
+
+std::unique_ptr<Request> Scheduler::Next() {
+    size_t selected = PriorityCount;
+
+    const size_t tickLane = static_cast<size_t>(Priority::Tick);
+    if (mode == DispatchMode::Strict) {
+        for (size_t i = 0; i < PriorityCount; i++) {
+            if (i != tickLane && !lanes[i].empty()) {
+                selected = i;
+                break;
+            }
+        }
+    }
+    else {
+        // Smooth weighted round robin: every busy lane earns its weight, the richest lane
+        // is served and pays back the total, so lanes interleave instead of bursting.
+        int totalWeight = 0;
+        for (size_t i = 0; i < PriorityCount; i++) {
+            if (i == tickLane || lanes[i].empty()) {
+                credits[i] = 0;
+                continue;
+            }
+            credits[i] += static_cast<int>(weights[i]);
+            totalWeight += static_cast<int>(weights[i]);
+            if (selected == PriorityCount || credits[i] > credits[selected]) {
+                selected = i;
+            }
+        }
+        if (selected != PriorityCount) {
+            credits[selected] -= totalWeight;
+        }
+    }
+
+    if (selected == PriorityCount) {
+        return nullptr;
+    }
+
+    std::unique_ptr<Request> request = std::move(lanes[selected].front());
+    lanes[selected].pop_front();
+
+    auto wait = std::chrono::steady_clock::now() - request->enqueued;
+    laneStats[selected].Record(static_cast<unsigned long long>(
+        std::chrono::duration_cast<std::chrono::microseconds>(wait).count()));
+    return request;
+}
+
+std::string Scheduler::Stats() {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::ostringstream out;
+    out << "mode=" << (mode == DispatchMode::Strict ? "strict" : "weighted") << "\n";
+    for (size_t i = 0; i < PriorityCount; i++) {
+        const LaneStats& stats = laneStats[i];
+        out << "lane=" << PriorityName(static_cast<Priority>(i))
+            << " weight=" << weights[i]
+            << " depth=" << lanes[i].size()
+            << " dispatched=" << stats.dispatched
+            << " wait_avg_us=" << (stats.dispatched ? stats.totalWaitMicros / stats.dispatched : 0)
+            << " wait_p99_us=" << stats.Percentile(0.99)
+            << " wait_max_us=" << stats.maxWaitMicros
+            << "\n";
+    }
+    out << "tick batches=" << tickLatency.dispatched
+        << " requests=" << tickRequests
+        << " failed=" << tickFailures
+        << " latency_avg_us=" << (tickLatency.dispatched ? tickLatency.totalWaitMicros / tickLatency.dispatched : 0)
+        << " latency_p99_us=" << tickLatency.Percentile(0.99)
+        << " latency_max_us=" << tickLatency.maxWaitMicros
+        << "\n";
+    out << cache.Stats();
+    if (evaluator) {
+        out << evaluator->Stats();
+    }
+    return out.str();
+}
+
+size_t Scheduler::Queued() {
+    std::lock_guard<std::mutex> lock(mtx);
+    size_t queued = 0;
+    for (size_t i = 0; i < PriorityCount; i++) {
+        queued += lanes[i].size();
+    }
+    return queued;
+}
+
+unsigned long long Scheduler::Dispatched() {
+    std::lock_guard<std::mutex> lock(mtx);
+    unsigned long long dispatched = 0;
+    for (size_t i = 0; i < PriorityCount; i++) {
+        dispatched += laneStats[i].dispatched;
+    }
+    return dispatched;
+}
+
+void Scheduler::ClearCache() {
+    cache.Clear();
+}
+
+bool Scheduler::ParsePriority(std::string& instruction, Priority& priority) {
+    priority = Priority::Interactive;
+    const std::string prefix = "<PRI=";
+    if (instruction.compare(0, prefix.size(), prefix) != 0) {
+        return true;
+    }
+
+    size_t end = instruction.find('>', prefix.size());
+    if (end == std::string::npos) {
+        return true;
+    }
+
+    // A misspelled lane would otherwise quietly run the request as interactive.
+    if (!PriorityFromName(instruction.substr(prefix.size(), end - prefix.size()), priority)) {
+        priority = Priority::Interactive;
+        return false;
+    }
+    instruction.erase(0, end + 1);
+    return true;
+}
+
+bool Scheduler::PriorityFromName(const std::string& name, Priority& priority) {
+    for (size_t i = 0; i < PriorityCount; i++) {
+        if (name == PriorityName(static_cast<Priority>(i)) || name == std::to_string(i)) {
+            priority = static_cast<Priority>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* Scheduler::PriorityName(Priority priority) {
+    switch (priority) {
+    case Priority::Interactive:
+        return "interactive";
+    case Priority::Bulk:
+        return "bulk";
+    case Priority::Tick:
+        return "tick";
+    }
+    return "unknown";
+}
+
+ThreadResult THREADCALL Scheduler::RunEvaluator(void* lpParam) {
+    Scheduler* scheduler = static_cast<Scheduler*>(lpParam);
+    // JavaAPI attaches the constructing thread to the JVM, so it must live on this thread.
+    JavaAPI javaAPI;
+    {
+        std::lock_guard<std::mutex> lock(scheduler->mtx);
+        scheduler->evaluator = &javaAPI;
+    }
+
+    const size_t tickLane = static_cast<size_t>(Priority::Tick);
+    while (true) {
+        std::unique_ptr<Request> request;
+        bool tickWaiting;
+        {
+            std::unique_lock<std::mutex> lock(scheduler->mtx);
+            auto ready = [&](bool includeTick) {
+                if (!scheduler->running) {
+                    return true;
+                }
+                for (size_t i = 0; i < PriorityCount; i++) {
+                    if ((includeTick || i != tickLane) && !scheduler->lanes[i].empty()) {
+                        return true;
+                    }
+                }
+                return false;
+            };
+            if (scheduler->lanes[tickLane].empty()) {
+                scheduler->cv.wait(lock, [&] { return ready(true); });
+            }
+            else {
+                // Nothing signals a new tick, so poll the counter between regular requests.
+                scheduler->cv.wait_for(lock, std::chrono::milliseconds(TickPollMillis), [&] { return ready(false); });
+            }
+            if (!scheduler->running) {
+                break;
+            }
+            request = scheduler->Next();
+            tickWaiting = !scheduler->lanes[tickLane].empty();
+        }
+
+        if (tickWaiting) {
+            scheduler->ServeTickLane(javaAPI);
+        }
+        if (!request) {
+            continue;
+        }
+
+        request->complete(scheduler->Evaluate(javaAPI, *request));
+    }
+
+    // Fail whatever is still queued so waiting clients are released.
+    std::lock_guard<std::mutex> lock(scheduler->mtx);
+    scheduler->evaluator = nullptr;
+    for (size_t i = 0; i < PriorityCount; i++) {
+        for (auto& request : scheduler->lanes[i]) {
+            request->complete(ErrorInfo(ErrorCode::Internal, "Server is shutting down").Format());
+        }
+        scheduler->lanes[i].clear();
+    }
+    return 0;
+}
+
+std::string Scheduler::Evaluate(JavaAPI& javaAPI, const Request& request) {
+    std::string key = request.cache.enabled ? ResultCache::Key(request.instruction, request.session) : std::string();
+    int tick = -1;
+    auto now = std::chrono::steady_clock::now();
+    std::string response;
+    if (!key.empty()) {
+        // Only tick-scoped entries need the counter, and reading it is a JNI call.
+        if (request.cache.ttlMillis == 0) {
+            tick = javaAPI.TickCount();
+        }
+        if (cache.Lookup(key, tick, now, response)) {
+            return response;
+        }
+    }
+
+    try {
+        response = javaAPI.ProcessInstruction(request.instruction, request.session);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Evaluation failed: " << e.what() << std::endl;
+        return ErrorInfo(ErrorCode::Internal, std::string("Evaluation failed: ") + e.what()).Format();
+    }
+    // Failures are not remembered; the next request tries again.
+    if (!key.empty() && !ErrorInfo::IsError(response)) {
+        cache.Store(key, response, request.cache, tick, now);
+    }
+    return response;
+}
+
+void Scheduler::ServeTickLane(JavaAPI& javaAPI) {
+    const size_t tickLane = static_cast<size_t>(Priority::Tick);
+    jint tick = javaAPI.TickCount();
+    auto now = std::chrono::steady_clock::now();
+    if (!tickArmed) {
+        tickArmed = true;
+        armedTick = tick;
+        armedAt = now;
+        return;
+    }
+    // Without a tick counter (no client yet) the lane waits for the limit like one whose
+    // tick does not advance, so a client on the login screen gets its answers late rather
+    // than never.
+    auto waited = std::chrono::duration_cast<std::chrono::milliseconds>(now - armedAt).count();
+    if ((tick < 0 || tick == armedTick) && waited < TickWaitLimitMillis) {
+        return;
+    }
+
+    std::vector<std::unique_ptr<Request>> batch;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        LaneStats& stats = laneStats[tickLane];
+        for (auto& request : lanes[tickLane]) {
+            stats.Record(static_cast<unsigned long long>(
+                std::chrono::duration_cast<std::chrono::microseconds>(now - request->enqueued).count()));
+            batch.push_back(std::move(request));
+        }
+        lanes[tickLane].clear();
+    }
+    tickArmed = false;
+    if (batch.empty()) {
+        return;
+    }
+
+    std::vector<std::string> instructions;
+    std::vector<uint32_t> sessions;
+    instructions.reserve(batch.size());
+    sessions.reserve(batch.size());
+    for (auto& request : batch) {
+        instructions.push_back(request->instruction);
+        sessions.push_back(request->session);
+    }
+
+    std::vector<std::string> responses;
+    bool batched = true;
+    try {
+        responses = javaAPI.ProcessTick(instructions, sessions, batched);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Tick evaluation failed: " << e.what() << std::endl;
+        responses.assign(batch.size(), ErrorInfo(ErrorCode::Internal, std::string("Evaluation failed: ") + e.what()).Format());
+    }
+    for (size_t i = 0; i < batch.size(); i++) {
+        batch[i]->complete(responses[i]);
+    }
+
+    std::lock_guard<std::mutex> lock(mtx);
+    tickLatency.Record(static_cast<unsigned long long>(
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - now).count()));
+    tickRequests += batch.size();
+    if (!batched) {
+        tickFailures++;
+    }
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include "pch.h"
+#include <string>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <chrono>
+#include <functional>
+#include "JavaAPI.hpp"
+#include "Platform.hpp"
+#include "ResultCache.hpp"
+
+// Priority class a request is queued under. Lower value = more latency sensitive, except
+// for Tick: those requests are not dispatched one by one but together once per game tick,
+// in a single callback on the client thread, so they all see the same game state.
+enum class Priority {
+    Interactive = 0,
+    Bulk = 1,
+    Tick = 2
+};
+
+const size_t PriorityCount = 3;
+
+// How the evaluator thread picks between non-empty lanes.
+enum class DispatchMode {
+    Strict,       // always drain the highest priority lane first
+    WeightedFair  // smooth weighted round robin using the lane weights
+};
+
+struct Request {
+    std::string instruction;
+    Priority priority;
+    uint32_t session;
+    CachePolicy cache;
+    std::chrono::steady_clock::time_point enqueued;
+    // Invoked on the evaluator thread with the result.
+    std::function<void(const std::string&)> complete;
+};
+
+struct LaneStats {
+    static const size_t SampleCount = 1024;
+
+    unsigned long long dispatched = 0;
+    unsigned long long totalWaitMicros = 0;
+    unsigned long long maxWaitMicros = 0;
+    // Ring of the most recent wait times, used for the p99 estimate.
+    std::vector<unsigned long long> samples;
+    size_t nextSample = 0;
+
+    void Record(unsigned long long waitMicros);
+    unsigned long long Percentile(double p) const;
+};
+
+class Scheduler {
+public:
+    Scheduler(DispatchMode mode = DispatchMode::WeightedFair);
+    ~Scheduler();
+
+    void Start();
+    void Stop();
+    // Queues a request; once the scheduler has stopped it is answered with an error at once.
+    std::future<std::string> Submit(const std::string& instruction, Priority priority, uint32_t session);
+    void Submit(const std::string& instruction, Priority priority, uint32_t session, std::function<void(const std::string&)> complete);
+    void SetMode(DispatchMode mode);
+    void SetWeight(Priority priority, unsigned int weight);
+    std::string Stats();
+    // Requests waiting in any lane, and requests handed to the evaluator so far.
+    size_t Queued();
+    unsigned long long Dispatched();
+    void ClearCache();
+
+    // Strips an optional "<PRI=interactive>" / "<PRI=bulk>" / "<PRI=tick>" prefix from the
+    // instruction. False, leaving the instruction as it is, if the prefix names no lane.
+    static bool ParsePriority(std::string& instruction, Priority& priority);
+    // Accepts a lane's name or number.
+    static bool PriorityFromName(const std::string& name, Priority& priority);
+    static const char* PriorityName(Priority priority);
+    static ThreadResult THREADCALL RunEvaluator(void* lpParam);
+
+    // How often the evaluator looks at the tick counter while tick requests wait, and how
+    // long they wait for a tick that does not come (e.g. on the login screen).
+    static const uint32_t TickPollMillis = 5;
+    static const uint32_t TickWaitLimitMillis = 2000;
+
+private:
+    friend class SchedulerTest; // drives Next() without an evaluator thread
+
+    std::unique_ptr<Request> Next(); // caller must hold mtx
+    // Evaluator thread: hands the tick lane to the evaluator once a new tick has started.
+    void ServeTickLane(JavaAPI& javaAPI);
+    // Evaluator thread: answers from the result cache if the request opted in and it can.
+    std::string Evaluate(JavaAPI& javaAPI, const Request& request);
+
+    std::deque<std::unique_ptr<Request>> lanes[PriorityCount];
+    LaneStats laneStats[PriorityCount];
+    unsigned int weights[PriorityCount];
+    int credits[PriorityCount];
+    DispatchMode mode;
+
+    // Tick batches: time from noticing the new tick to answering its requests.
+    LaneStats tickLatency;
+    unsigned long long tickRequests;
+    unsigned long long tickFailures;
+    // Evaluator thread only. The lane is armed with the tick it first waited in and is
+    // dispatched when the counter moves on.
+    bool tickArmed;
+    int armedTick;
+    std::chrono::steady_clock::time_point armedAt;
+
+    ResultCache cache;
+
+    bool running;
+    ThreadHandle evaluatorThread; // valid while running
+    JavaAPI* evaluator; // owned by the evaluator thread, set while it runs
+    std::mutex mtx;
+    std::condition_variable cv;
+};
@@ -0,0 +1,55 @@
+#pragma once
+#include "pch.h"
+#include <string>
+#include <atomic>
+#include <cstddef>
+#include "Platform.hpp"
+
+// Byte stream to one connected client. Reads and writes may run concurrently on different
+// threads (one reader, one writer). TransportWin32.cpp implements it over an overlapped
+// named pipe instance, TransportPosix.cpp over a Unix domain socket.
+class Connection {
+public:
+    explicit Connection(NativeHandle handle);
+    ~Connection();
+
+    Connection(const Connection&) = delete;
+    void operator=(const Connection&) = delete;
+
+    // Blocks until at least one byte is available; false on error or disconnect.
+    bool Read(char* data, size_t size, size_t& transferred);
+    bool Write(const char* data, size_t size, size_t& transferred);
+    // Bytes that can be read without blocking.
+    bool Available(size_t& bytes);
+    void Flush();
+    void Close();
+
+private:
+    NativeHandle handle;
+};
+
+// Accepts connections on an endpoint: a pipe name like "\\.\pipe\jshellpipe" on Windows,
+// a socket path like "/tmp/jshellpipe.sock" elsewhere.
+class Listener {
+public:
+    Listener(const std::string& endpoint, size_t bufferSize);
+    ~Listener();
+
+    Listener(const Listener&) = delete;
+    void operator=(const Listener&) = delete;
+
+    bool Open();
+    // Blocks until a client connects. Returns nullptr if accepting failed or the listener
+    // was closed; the caller owns the returned connection.
+    Connection* Accept();
+    // Stops accepting; a thread blocked in Accept() returns nullptr. Safe from any thread.
+    void Close();
+
+    const std::string& Endpoint() const { return endpoint; }
+
+private:
+    std::string endpoint;
+    size_t bufferSize;
+    NativeHandle handle;
+    std::atomic<bool> open;
+};
@@ -0,0 +1,125 @@
+#include "pch.h"
+#include "Transport.hpp"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+Connection::Connection(NativeHandle handle) : handle(handle) {
+}
+
+Connection::~Connection() {
+    Close();
+}
+
+bool Connection::Read(char* data, size_t size, size_t& transferred) {
+    ssize_t count;
+    do {
+        count = recv(handle, data, size, 0);
+    } while (count < 0 && errno == EINTR);
+
+    // A zero-byte read is the peer closing its end.
+    transferred = count > 0 ? static_cast<size_t>(count) : 0;
+    return count > 0;
+}
+
+bool Connection::Write(const char* data, size_t size, size_t& transferred) {
+    ssize_t count;
+    do {
+        // MSG_NOSIGNAL: a client that went away is an error here, not a SIGPIPE.
+        count = send(handle, data, size, MSG_NOSIGNAL);
+    } while (count < 0 && errno == EINTR);
+
+    transferred = count > 0 ? static_cast<size_t>(count) : 0;
+    return count >= 0;
+}
+
+bool Connection::Available(size_t& bytes) {
+    int bytesAvailable = 0;
+    if (ioctl(handle, FIONREAD, &bytesAvailable) != 0) {
+        return false;
+    }
+    bytes = static_cast<size_t>(bytesAvailable);
+    return true;
+}
+
+void Connection::Flush() {
+    // Socket writes are handed to the kernel immediately.
+}
+
+void Connection::Close() {
+    if (handle >= 0) {
+        shutdown(handle, SHUT_RDWR);
+        close(handle);
+        handle = -1;
+    }
+}
+
+Listener::Listener(const std::string& endpoint, size_t bufferSize)
+    : endpoint(endpoint), bufferSize(bufferSize), handle(-1), open(false) {
+}
+
+Listener::~Listener() {
+    Close();
+    if (handle >= 0) {
+        close(handle);
+        unlink(endpoint.c_str());
+    }
+}
+
+bool Listener::Open() {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (endpoint.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path too long: " << endpoint << std::endl;
+        return false;
+    }
+    memcpy(address.sun_path, endpoint.c_str(), endpoint.size() + 1);
+
+    handle = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (handle < 0) {
+        std::cerr << "Failed to create socket. Error Code: " << errno << std::endl;
+        return false;
+    }
+
+    // A socket file left behind by a host that did not shut down cleanly blocks bind().
+    unlink(endpoint.c_str());
+    if (bind(handle, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(handle, SOMAXCONN) != 0) {
+        std::cerr << "Failed to listen on " << endpoint << ". Error Code: " << errno << std::endl;
+        close(handle);
+        handle = -1;
+        return false;
+    }
+    open = true;
+    return true;
+}
+
+Connection* Listener::Accept() {
+    if (handle < 0) {
+        return nullptr;
+    }
+
+    int client;
+    do {
+        client = accept(handle, nullptr, nullptr);
+    } while (client < 0 && errno == EINTR && open);
+    if (client < 0) {
+        return nullptr;
+    }
+
+    int size = static_cast<int>(bufferSize);
+    setsockopt(client, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    setsockopt(client, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    return new Connection(client);
+}
+
+void Listener::Close() {
+    open = false;
+    if (handle >= 0) {
+        // Wakes a thread blocked in accept(); the descriptor is closed by the destructor.
+        shutdown(handle, SHUT_RDWR);
+    }
+}
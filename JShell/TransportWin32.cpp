@@ -0,0 +1,162 @@
+#include "pch.h"
+#include "Transport.hpp"
+#include <iostream>
+
+namespace {
+    bool OverlappedTransfer(HANDLE pipe, bool write, void* data, DWORD size, DWORD& transferred) {
+        OVERLAPPED overlapped = {};
+        overlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+        if (!overlapped.hEvent) {
+            return false;
+        }
+
+        BOOL ok = write
+            ? ::WriteFile(pipe, data, size, &transferred, &overlapped)
+            : ::ReadFile(pipe, data, size, &transferred, &overlapped);
+        if (!ok && GetLastError() == ERROR_IO_PENDING) {
+            ok = GetOverlappedResult(pipe, &overlapped, &transferred, TRUE);
+        }
+
+        CloseHandle(overlapped.hEvent);
+        return ok != FALSE;
+    }
+}
+
+Connection::Connection(NativeHandle handle) : handle(handle) {
+}
+
+Connection::~Connection() {
+    Close();
+}
+
+bool Connection::Read(char* data, size_t size, size_t& transferred) {
+    DWORD count = 0;
+    bool ok = OverlappedTransfer(handle, false, data, static_cast<DWORD>(size), count);
+    transferred = count;
+    return ok;
+}
+
+bool Connection::Write(const char* data, size_t size, size_t& transferred) {
+    DWORD count = 0;
+    bool ok = OverlappedTransfer(handle, true, const_cast<char*>(data), static_cast<DWORD>(size), count);
+    transferred = count;
+    return ok;
+}
+
+bool Connection::Available(size_t& bytes) {
+    DWORD bytesAvailable = 0;
+    if (!::PeekNamedPipe(handle, NULL, 0, NULL, &bytesAvailable, NULL)) {
+        return false;
+    }
+    bytes = bytesAvailable;
+    return true;
+}
+
+void Connection::Flush() {
+    FlushFileBuffers(handle);
+}
+
+void Connection::Close() {
+    if (handle != INVALID_HANDLE_VALUE) {
+        DisconnectNamedPipe(handle);
+        CloseHandle(handle);
+        handle = INVALID_HANDLE_VALUE;
+    }
+}
+
+Listener::Listener(const std::string& endpoint, size_t bufferSize)
+    : endpoint(endpoint), bufferSize(bufferSize), handle(INVALID_HANDLE_VALUE), open(false) {
+}
+
+Listener::~Listener() {
+    Close();
+    if (handle != INVALID_HANDLE_VALUE) {
+        CloseHandle(handle);
+    }
+}
+
+bool Listener::Open() {
+    // Every client gets its own pipe instance; this creates the one the next client
+    // connects to.
+    handle = CreateNamedPipeA(
+        endpoint.c_str(),
+        PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED,
+        PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT,
+        PIPE_UNLIMITED_INSTANCES,
+        static_cast<DWORD>(bufferSize),
+        static_cast<DWORD>(bufferSize),
+        0,
+        NULL);
+
+    if (handle == INVALID_HANDLE_VALUE) {
+        DWORD error = GetLastError();
+        LPSTR lpMsgBuf = nullptr;
+
+        FormatMessageA(
+            FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM,
+            NULL,
+            error,
+            0, // Default language
+            (LPSTR)&lpMsgBuf,
+            0,
+            NULL
+        );
+
+        // Display the error message in a message box
+        MessageBoxA(NULL, lpMsgBuf ? lpMsgBuf : "Failed to create named pipe.", "Error", MB_OK | MB_ICONERROR);
+
+        LocalFree(lpMsgBuf);
+        return false;
+    }
+    open = true;
+    return true;
+}
+
+Connection* Listener::Accept() {
+    if (handle == INVALID_HANDLE_VALUE && (!open || !Open())) {
+        return nullptr;
+    }
+
+    OVERLAPPED overlapped = {};
+    overlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    BOOL connected = ConnectNamedPipe(handle, &overlapped);
+    if (!connected) {
+        DWORD error = GetLastError();
+        DWORD unused = 0;
+        if (error == ERROR_PIPE_CONNECTED) {
+            connected = TRUE;
+        }
+        else if (error == ERROR_IO_PENDING) {
+            connected = GetOverlappedResult(handle, &overlapped, &unused, TRUE);
+        }
+    }
+    if (overlapped.hEvent) {
+        CloseHandle(overlapped.hEvent);
+    }
+
+    if (!connected) {
+        // Recreate the instance so the next Accept() starts clean.
+        CloseHandle(handle);
+        handle = INVALID_HANDLE_VALUE;
+        if (open) {
+            Open();
+        }
+        return nullptr;
+    }
+
+    // Hand the connected instance over and create a fresh one for the next client.
+    Connection* connection = new Connection(handle);
+    handle = INVALID_HANDLE_VALUE;
+    if (open) {
+        Open();
+    }
+    return connection;
+}
+
+void Listener::Close() {
+    open = false;
+    if (handle != INVALID_HANDLE_VALUE) {
+        // Aborts a pending ConnectNamedPipe; Accept() closes the instance.
+        CancelIoEx(handle, NULL);
+    }
+}
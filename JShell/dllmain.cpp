@@ -7,7 +7,7 @@
 HANDLE serverThread = NULL;
 
 BOOL APIENTRY DllMain(HMODULE hModule, DWORD ul_reason_for_call, LPVOID lpReserved) {
-    static Pipeline pipeline(L"\\\\.\\pipe\\jshellpipe", 65535); // Static initialization will persist
+    static Pipeline pipeline(DefaultEndpoint(), 65535); // Static initialization will persist
 
     switch (ul_reason_for_call) {
     case DLL_PROCESS_ATTACH:
@@ -19,7 +19,7 @@ BOOL APIENTRY DllMain(HMODULE hModule, DWORD ul_reason_for_call, LPVOID lpReserv
 
     case DLL_PROCESS_DETACH:
         // Signal the server to stop
-        pipeline.running = false;
+        pipeline.Stop();
 
         // Wait for the server thread to finish
         if (serverThread) {
@@ -0,0 +1,102 @@
+#include "pch.h"
+#include "Pipeline.hpp"
+#include "Platform.hpp"
+#include <jni.h>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <signal.h>
+
+// Headless host for the server core. Instead of being injected into the game client it
+// creates its own JVM with the stub client classes from host/java, then serves the same
+// protocol as JShell.dll on a Unix domain socket, so throughput and memory tests can run
+// on Linux build machines.
+//
+//   jshell-host [endpoint]
+//
+// Without an argument the socket is JSHELL_ENDPOINT or /tmp/jshellpipe-<pid>.sock, so
+// several hosts can run side by side; each registers itself for discovery (see
+// EndpointRegistry.hpp). JSHELL_HOST_CLASSPATH replaces the stub jar and
+// JSHELL_JVM_OPTIONS adds JVM options (space separated).
+
+#ifndef JSHELL_HOST_CLASSPATH
+#define JSHELL_HOST_CLASSPATH "jshell-host-stubs.jar"
+#endif
+
+int main(int argc, char** argv) {
+    std::string endpoint = argc > 1 ? argv[1] : DefaultEndpoint();
+    const char* classpath = getenv("JSHELL_HOST_CLASSPATH");
+
+    // SIGINT/SIGTERM are handled by sigwait below. Block them before any thread exists so
+    // every thread, JVM threads included, inherits the mask; -Xrs keeps the JVM from
+    // installing its own handlers.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    std::vector<std::string> optionStrings;
+    optionStrings.push_back(std::string("-Djava.class.path=") + (classpath ? classpath : JSHELL_HOST_CLASSPATH));
+    optionStrings.push_back("-Djava.awt.headless=true");
+    optionStrings.push_back("-Xrs");
+    if (const char* extra = getenv("JSHELL_JVM_OPTIONS")) {
+        std::istringstream options(extra);
+        std::string option;
+        while (options >> option) {
+            optionStrings.push_back(option);
+        }
+    }
+
+    std::vector<JavaVMOption> options(optionStrings.size());
+    for (size_t i = 0; i < optionStrings.size(); i++) {
+        options[i].optionString = const_cast<char*>(optionStrings[i].c_str());
+        options[i].extraInfo = nullptr;
+    }
+
+    JavaVMInitArgs args = {};
+    args.version = JNI_VERSION_1_8;
+    args.nOptions = static_cast<jint>(options.size());
+    args.options = options.data();
+    args.ignoreUnrecognized = JNI_FALSE;
+
+    JavaVM* jvm = nullptr;
+    JNIEnv* env = nullptr;
+    if (JNI_CreateJavaVM(&jvm, reinterpret_cast<void**>(&env), &args) != JNI_OK) {
+        std::cerr << "Failed to create the JVM." << std::endl;
+        return 1;
+    }
+
+    // Fail at startup rather than on the first query if the stubs are not on the classpath.
+    const char* stubs[] = { "com/hydratech/jshell/ShellPanel", "net/runelite/client/RuneLite" };
+    for (const char* name : stubs) {
+        jclass stub = env->FindClass(name);
+        if (!stub) {
+            env->ExceptionDescribe();
+            std::cerr << "Stub class " << name << " not found on the classpath." << std::endl;
+            jvm->DestroyJavaVM();
+            return 1;
+        }
+        env->DeleteLocalRef(stub);
+    }
+
+    Pipeline pipeline(endpoint, 65535);
+    ThreadHandle serverThread;
+    if (!StartThread(Pipeline::RunServer, &pipeline, &serverThread)) {
+        std::cerr << "Failed to start the server thread." << std::endl;
+        jvm->DestroyJavaVM();
+        return 1;
+    }
+    std::cout << "Serving on " << endpoint << std::endl;
+
+    int received = 0;
+    sigwait(&signals, &received);
+    std::cout << "Shutting down." << std::endl;
+
+    pipeline.Stop();
+    JoinThread(serverThread);
+    jvm->DestroyJavaVM();
+    return 0;
+}
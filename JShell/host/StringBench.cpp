@@ -0,0 +1,277 @@
+#include "pch.h"
+#include "JniStrings.hpp"
+#include <jni.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Microbenchmark for JniStrings against the GetStringUTFChars/NewStringUTF path it replaced,
+// on the shapes of text the evaluator moves: short values, large dumps and non-ASCII names.
+//
+//   jshell-string-bench [megabytes per case]
+//
+// Runs in a JVM of its own and needs no classpath. "exact" says whether the path produced
+// the original UTF-8; the old path does not once a character lies outside the BMP. Before
+// timing anything it checks the conversions against the plain per-unit loops below, on
+// inputs placed around the 8- and 16-unit vector boundaries, and exits with 2 on a mismatch.
+
+namespace {
+    struct Corpus {
+        const char* name;
+        std::string text;
+    };
+
+    std::string Repeat(const std::string& unit, size_t size) {
+        std::string text;
+        while (text.size() < size) {
+            text += unit;
+        }
+        return text;
+    }
+
+    template <typename Body>
+    double NanosPerOp(size_t iterations, Body body) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++) {
+            body();
+        }
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() / iterations;
+    }
+
+    void Report(const Corpus& corpus, const char* path, double nanos, bool exact) {
+        double megabytesPerSecond = corpus.text.size() / nanos * 1e9 / (1024.0 * 1024.0);
+        std::cout << std::left << std::setw(12) << corpus.name
+            << std::setw(22) << path
+            << std::right << std::fixed << std::setprecision(1)
+            << std::setw(12) << nanos << " ns/op"
+            << std::setw(10) << megabytesPerSecond << " MB/s"
+            << (exact ? "  exact" : "  MANGLED") << std::endl;
+    }
+
+    // Reference conversions: the scalar loops of JniStrings without the ASCII fast paths.
+    std::vector<char> ReferenceUtf8(const std::vector<jchar>& in) {
+        std::vector<char> out;
+        auto put = [&out](uint32_t c) {
+            if (c < 0x80) {
+                out.push_back(static_cast<char>(c));
+            }
+            else if (c < 0x800) {
+                out.push_back(static_cast<char>(0xC0 | (c >> 6)));
+                out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+            }
+            else if (c < 0x10000) {
+                out.push_back(static_cast<char>(0xE0 | (c >> 12)));
+                out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+            }
+            else {
+                out.push_back(static_cast<char>(0xF0 | (c >> 18)));
+                out.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+            }
+        };
+        for (size_t i = 0; i < in.size(); i++) {
+            uint32_t c = in[i];
+            if (c >= 0xD800 && c <= 0xDBFF && i + 1 < in.size() && in[i + 1] >= 0xDC00 && in[i + 1] <= 0xDFFF) {
+                put(0x10000 + ((c - 0xD800) << 10) + (in[++i] - 0xDC00));
+            }
+            else {
+                put(c >= 0xD800 && c <= 0xDFFF ? 0xFFFD : c);
+            }
+        }
+        return out;
+    }
+
+    std::vector<jchar> ReferenceUtf16(const std::string& in) {
+        std::vector<jchar> out;
+        auto put = [&out](uint32_t c) {
+            if (c < 0x10000) {
+                out.push_back(static_cast<jchar>(c));
+            }
+            else {
+                out.push_back(static_cast<jchar>(0xD800 + ((c - 0x10000) >> 10)));
+                out.push_back(static_cast<jchar>(0xDC00 + ((c - 0x10000) & 0x3FF)));
+            }
+        };
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(in.data());
+        size_t i = 0;
+        while (i < in.size()) {
+            unsigned char c = bytes[i];
+            size_t needed = c >= 0xC2 && c <= 0xDF ? 1 : c >= 0xE0 && c <= 0xEF ? 2 : c >= 0xF0 && c <= 0xF4 ? 3 : 0;
+            if (c < 0x80) {
+                put(c);
+                i++;
+                continue;
+            }
+            uint32_t value = c & (0x3F >> needed);
+            unsigned char lower = c == 0xE0 ? 0xA0 : c == 0xF0 ? 0x90 : 0x80;
+            unsigned char upper = c == 0xED ? 0x9F : c == 0xF4 ? 0x8F : 0xBF;
+            size_t consumed = 1;
+            while (consumed <= needed && i + consumed < in.size() && bytes[i + consumed] >= lower && bytes[i + consumed] <= upper) {
+                value = (value << 6) | (bytes[i + consumed] & 0x3F);
+                lower = 0x80;
+                upper = 0xBF;
+                consumed++;
+            }
+            put(needed > 0 && consumed > needed ? value : 0xFFFD);
+            i += consumed;
+        }
+        return out;
+    }
+
+    // Every special unit sequence at every position of ASCII runs 0-40 units long. Returns
+    // the number of mismatches, each reported.
+    int CheckConversions() {
+        struct Units {
+            std::vector<jchar> units;
+            bool wellFormed; // comes back unchanged from UTF-8
+        };
+        const std::vector<Units> units = {
+            { { 0xD83D, 0xDC09 }, true },   // surrogate pair
+            { { 0xD83D }, false },          // unpaired high surrogate
+            { { 0xDC09 }, false },          // unpaired low surrogate
+            { { 0xDC09, 0xD83D }, false },  // pair in the wrong order
+            { { 0x0000 }, true },           // embedded NUL
+            { { 0x00DC }, true },           // two bytes
+            { { 0x540D }, true },           // three bytes
+            { { 0x0080 }, true },           // first unit past ASCII
+        };
+        const std::vector<std::string> bytes = {
+            "\xF0\x9F\x90\x89",  // four bytes
+            std::string(1, '\0'),
+            "\x80",              // stray continuation
+            "\xC0\xAF",          // overlong
+            "\xED\xA0\x80",      // encoded surrogate
+            "\xF4\x90\x80\x80",  // past U+10FFFF
+            "\xE5\x90",          // truncated
+            "\xFF",
+        };
+
+        int failures = 0;
+        for (size_t length = 0; length <= 40; length++) {
+            for (size_t at = 0; at <= length; at++) {
+                for (const Units& special : units) {
+                    std::vector<jchar> in(length, 'a');
+                    in.insert(in.begin() + at, special.units.begin(), special.units.end());
+                    std::vector<char> out(3 * in.size() + 1);
+                    out.resize(JniStrings::Utf16ToUtf8(in.data(), in.size(), out.data()));
+                    if (out != ReferenceUtf8(in)) {
+                        std::cerr << "Utf16ToUtf8 differs: " << length << " units, special at " << at << std::endl;
+                        failures++;
+                    }
+                    std::string text(out.begin(), out.end());
+                    std::vector<jchar> back(text.size() + 1);
+                    back.resize(JniStrings::Utf8ToUtf16(text.data(), text.size(), back.data()));
+                    if (back != ReferenceUtf16(text) || (special.wellFormed && back != in)) {
+                        std::cerr << "Utf8ToUtf16 does not round-trip: " << length << " units, special at " << at << std::endl;
+                        failures++;
+                    }
+                }
+                for (const std::string& special : bytes) {
+                    std::string in(length, 'a');
+                    in.insert(at, special);
+                    std::vector<jchar> out(in.size() + 1);
+                    out.resize(JniStrings::Utf8ToUtf16(in.data(), in.size(), out.data()));
+                    if (out != ReferenceUtf16(in)) {
+                        std::cerr << "Utf8ToUtf16 differs: " << length << " bytes, special at " << at << std::endl;
+                        failures++;
+                    }
+                }
+            }
+        }
+        return failures;
+    }
+
+    std::string ReadOld(JNIEnv* env, jstring string) {
+        std::string out;
+        const char* chars = env->GetStringUTFChars(string, nullptr);
+        std::string value(chars);
+        env->ReleaseStringUTFChars(string, chars);
+        out += value;
+        return out;
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t megabytes = argc > 1 ? static_cast<size_t>(atoi(argv[1])) : 64;
+    if (megabytes == 0) {
+        megabytes = 64;
+    }
+    if (CheckConversions() != 0) {
+        return 2;
+    }
+
+    JavaVMOption options[] = { { const_cast<char*>("-Xrs"), nullptr } };
+    JavaVMInitArgs args = {};
+    args.version = JNI_VERSION_1_8;
+    args.nOptions = 1;
+    args.options = options;
+    args.ignoreUnrecognized = JNI_FALSE;
+
+    JavaVM* jvm = nullptr;
+    JNIEnv* env = nullptr;
+    if (JNI_CreateJavaVM(&jvm, reinterpret_cast<void**>(&env), &args) != JNI_OK) {
+        std::cerr << "Failed to create the JVM." << std::endl;
+        return 1;
+    }
+
+    std::vector<Corpus> corpora = {
+        { "short", "java.awt.Rectangle[x=12,y=34,width=765,height=503]" },
+        { "ascii-64k", Repeat("net.runelite.api.coords.WorldPoint(x=3222, y=3218, plane=0)\n", 64 * 1024) },
+        // "Zezima <dragon> Ünïcödé 名前" spelled as bytes so the source stays ASCII.
+        { "mixed-4k", Repeat("Zezima \xF0\x9F\x90\x89 \xC3\x9C" "n\xC3\xAF" "c\xC3\xB6" "d\xC3\xA9 "
+            "\xE5\x90\x8D\xE5\x89\x8D plain ascii padding text; ", 4 * 1024) },
+    };
+
+    JniStrings strings;
+    std::string response;
+    for (const Corpus& corpus : corpora) {
+        size_t iterations = megabytes * 1024 * 1024 / corpus.text.size() + 1;
+        jstring source = strings.New(env, corpus.text);
+
+        // Java -> response, the way the evaluator appends values.
+        double oldRead = NanosPerOp(iterations, [&]() {
+            response.clear();
+            response += ReadOld(env, source);
+        });
+        Report(corpus, "read  GetStringUTFChars", oldRead, ReadOld(env, source) == corpus.text);
+
+        double newRead = NanosPerOp(iterations, [&]() {
+            response.clear();
+            JniStrings::Append(env, source, response);
+        });
+        response.clear();
+        JniStrings::Append(env, source, response);
+        Report(corpus, "read  JniStrings", newRead, response == corpus.text);
+
+        // Instruction -> Java.
+        double oldWrite = NanosPerOp(iterations, [&]() {
+            env->DeleteLocalRef(env->NewStringUTF(corpus.text.c_str()));
+        });
+        jstring written = env->NewStringUTF(corpus.text.c_str());
+        response.clear();
+        JniStrings::Append(env, written, response);
+        env->DeleteLocalRef(written);
+        Report(corpus, "write NewStringUTF", oldWrite, response == corpus.text);
+
+        double newWrite = NanosPerOp(iterations, [&]() {
+            env->DeleteLocalRef(strings.New(env, corpus.text));
+        });
+        written = strings.New(env, corpus.text);
+        response.clear();
+        JniStrings::Append(env, written, response);
+        env->DeleteLocalRef(written);
+        Report(corpus, "write JniStrings", newWrite, response == corpus.text);
+
+        env->DeleteLocalRef(source);
+    }
+
+    jvm->DestroyJavaVM();
+    return 0;
+}
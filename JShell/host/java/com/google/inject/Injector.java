@@ -0,0 +1,9 @@
+package com.google.inject;
+
+/**
+ * Stand-in for Guice's injector, just enough for the headless host.
+ */
+public interface Injector
+{
+	<T> T getInstance(Class<T> type);
+}
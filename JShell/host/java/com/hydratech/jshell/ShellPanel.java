@@ -0,0 +1,31 @@
+package com.hydratech.jshell;
+
+import com.google.inject.Injector;
+import jdk.jshell.JShell;
+
+/**
+ * Headless stand-in for the plugin panel that owns the shell. JavaAPI reads INSTANCE and
+ * shell and calls switchContext, exactly as it does inside the game client.
+ */
+public class ShellPanel
+{
+	public static final ShellPanel INSTANCE = new ShellPanel();
+
+	private JShell shell;
+
+	/**
+	 * Replaces the shell with a fresh one that has the client in scope. Snippets run in this
+	 * JVM ("local" engine) so they see the same client object as the host.
+	 */
+	public synchronized void switchContext(Injector injector)
+	{
+		if (shell != null)
+		{
+			shell.close();
+		}
+		shell = JShell.builder().executionEngine("local").build();
+		shell.addToClasspath(System.getProperty("java.class.path"));
+		shell.eval("net.runelite.api.Client client = ((net.runelite.client.RuneLite) "
+			+ "net.runelite.client.RuneLite.injector.getInstance(net.runelite.client.RuneLite.class)).getClient();");
+	}
+}
@@ -0,0 +1,14 @@
+package net.runelite.api;
+
+/**
+ * The image the client renders each frame into, as in RuneLite: getWidth() * getHeight()
+ * pixels of 0xRRGGBB, rows top to bottom.
+ */
+public interface BufferProvider
+{
+	int[] getPixels();
+
+	int getWidth();
+
+	int getHeight();
+}
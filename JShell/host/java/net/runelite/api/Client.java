@@ -0,0 +1,17 @@
+package net.runelite.api;
+
+import java.awt.Canvas;
+
+/**
+ * The part of the RuneLite client API implemented by the headless host.
+ */
+public interface Client
+{
+	int getTickCount();
+
+	int getPlane();
+
+	Canvas getCanvas();
+
+	BufferProvider getBufferProvider();
+}
@@ -0,0 +1,67 @@
+package net.runelite.client;
+
+import java.awt.Canvas;
+import java.awt.Color;
+import java.awt.Graphics2D;
+import java.awt.image.BufferedImage;
+import java.awt.image.DataBufferInt;
+import net.runelite.api.BufferProvider;
+
+/**
+ * Canvas of the headless client, backed by a BufferedImage whose int[] raster is what the
+ * client's buffer provider hands out, as the game's is. The scene is a square that moves
+ * one step per game tick, so frames only change when the tick does.
+ */
+public class HeadlessCanvas extends Canvas
+{
+	public static final int FRAME_WIDTH = 765;
+	public static final int FRAME_HEIGHT = 503;
+	private static final int SQUARE = 32;
+
+	private final BufferedImage image = new BufferedImage(FRAME_WIDTH, FRAME_HEIGHT, BufferedImage.TYPE_INT_RGB);
+	private final int[] pixels = ((DataBufferInt) image.getRaster().getDataBuffer()).getData();
+	private final BufferProvider bufferProvider = new BufferProvider()
+	{
+		@Override
+		public int[] getPixels()
+		{
+			return pixels;
+		}
+
+		@Override
+		public int getWidth()
+		{
+			return FRAME_WIDTH;
+		}
+
+		@Override
+		public int getHeight()
+		{
+			return FRAME_HEIGHT;
+		}
+	};
+
+	HeadlessCanvas()
+	{
+		setSize(FRAME_WIDTH, FRAME_HEIGHT);
+	}
+
+	/**
+	 * Draws the frame for the given tick. Called on the client thread.
+	 */
+	void render(int tick)
+	{
+		Graphics2D graphics = image.createGraphics();
+		graphics.setColor(Color.BLACK);
+		graphics.fillRect(0, 0, FRAME_WIDTH, FRAME_HEIGHT);
+		graphics.setColor(Color.GREEN);
+		int step = tick * SQUARE;
+		graphics.fillRect(step % (FRAME_WIDTH - SQUARE), (step / (FRAME_WIDTH - SQUARE) * SQUARE) % (FRAME_HEIGHT - SQUARE), SQUARE, SQUARE);
+		graphics.dispose();
+	}
+
+	BufferProvider getBufferProvider()
+	{
+		return bufferProvider;
+	}
+}
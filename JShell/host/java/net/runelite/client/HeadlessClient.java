@@ -0,0 +1,77 @@
+package net.runelite.client;
+
+import java.awt.Canvas;
+import java.util.concurrent.Executors;
+import java.util.concurrent.ScheduledExecutorService;
+import java.util.concurrent.TimeUnit;
+import java.util.concurrent.atomic.AtomicInteger;
+import net.runelite.api.BufferProvider;
+import net.runelite.api.Client;
+import net.runelite.client.callback.ClientThread;
+
+/**
+ * Client for the headless host. Its client thread runs a frame every 20 ms, running code
+ * invoked through the ClientThread, and advances the tick counter every 600 ms like the
+ * game's, redrawing the canvas, so tick-driven code paths and frame capture can be
+ * exercised without a game session.
+ */
+public class HeadlessClient implements Client
+{
+	public static final long FRAME_MILLIS = 20;
+	public static final long TICK_MILLIS = 600;
+
+	private final AtomicInteger tickCount = new AtomicInteger();
+	private final HeadlessCanvas canvas = new HeadlessCanvas();
+	private final ClientThread clientThread = new ClientThread();
+	private int frames;
+
+	HeadlessClient()
+	{
+		ScheduledExecutorService frameLoop = Executors.newSingleThreadScheduledExecutor(runnable ->
+		{
+			Thread thread = new Thread(runnable, "headless-client");
+			thread.setDaemon(true);
+			return thread;
+		});
+		frameLoop.scheduleAtFixedRate(this::frame, FRAME_MILLIS, FRAME_MILLIS, TimeUnit.MILLISECONDS);
+	}
+
+	private void frame()
+	{
+		if (++frames == TICK_MILLIS / FRAME_MILLIS)
+		{
+			frames = 0;
+			canvas.render(tickCount.incrementAndGet());
+		}
+		clientThread.runFrame();
+	}
+
+	ClientThread getClientThread()
+	{
+		return clientThread;
+	}
+
+	@Override
+	public int getTickCount()
+	{
+		return tickCount.get();
+	}
+
+	@Override
+	public int getPlane()
+	{
+		return 0;
+	}
+
+	@Override
+	public Canvas getCanvas()
+	{
+		return canvas;
+	}
+
+	@Override
+	public BufferProvider getBufferProvider()
+	{
+		return canvas.getBufferProvider();
+	}
+}
@@ -0,0 +1,44 @@
+package net.runelite.client;
+
+import com.google.inject.Injector;
+import net.runelite.api.Client;
+import net.runelite.client.callback.ClientThread;
+
+/**
+ * Mirrors the fields JavaAPI::getClient reads from the real RuneLite class: the static
+ * injector, and the client field of the RuneLite instance it provides. The injector also
+ * provides the ClientThread that tick batches are run on.
+ */
+public class RuneLite
+{
+	public static Injector injector;
+
+	private final Client client = new HeadlessClient();
+
+	static
+	{
+		RuneLite instance = new RuneLite();
+		injector = new Injector()
+		{
+			@Override
+			public <T> T getInstance(Class<T> type)
+			{
+				if (type == ClientThread.class)
+				{
+					return type.cast(((HeadlessClient) instance.client).getClientThread());
+				}
+				return type.isInstance(instance) ? type.cast(instance) : null;
+			}
+		};
+	}
+
+	public static Injector getInjector()
+	{
+		return injector;
+	}
+
+	public Client getClient()
+	{
+		return client;
+	}
+}
@@ -0,0 +1,49 @@
+package net.runelite.client.callback;
+
+import java.util.Queue;
+import java.util.concurrent.ConcurrentLinkedQueue;
+
+/**
+ * Runs code on the client thread between frames, like RuneLite's ClientThread. Tick batches
+ * from the server arrive through invoke.
+ */
+public class ClientThread
+{
+	private final Queue<Runnable> invokes = new ConcurrentLinkedQueue<>();
+	private volatile Thread clientThread;
+
+	/**
+	 * Runs the runnable now if called on the client thread, otherwise at the next frame.
+	 */
+	public void invoke(Runnable runnable)
+	{
+		if (Thread.currentThread() == clientThread)
+		{
+			runnable.run();
+		}
+		else
+		{
+			invokes.add(runnable);
+		}
+	}
+
+	/**
+	 * Called by the client once per frame, on the client thread.
+	 */
+	public void runFrame()
+	{
+		clientThread = Thread.currentThread();
+		Runnable runnable;
+		while ((runnable = invokes.poll()) != null)
+		{
+			try
+			{
+				runnable.run();
+			}
+			catch (Throwable t)
+			{
+				t.printStackTrace();
+			}
+		}
+	}
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <iostream>
+
+// Assertions for the unit tests. A failed CHECK is reported with its line and the test
+// carries on; main returns CheckFailures() so ctest sees the failure.
+
+inline int& CheckFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #condition << std::endl; \
+            CheckFailures()++; \
+        } \
+    } while (0)
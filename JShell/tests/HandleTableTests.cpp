@@ -0,0 +1,119 @@
+#include "pch.h"
+#include "HandleTable.hpp"
+#include "Check.hpp"
+#include <string>
+
+// Unit tests for HandleTable: generations, session scoping, limits and reference rewriting.
+// Only the table's bookkeeping is exercised; no JVM is created.
+
+namespace {
+    std::string WithToken(const std::string& text, uint32_t id) {
+        std::string result = text;
+        size_t pos;
+        while ((pos = result.find("ID")) != std::string::npos) {
+            result.replace(pos, 2, HandleTable::Token(id));
+        }
+        return result;
+    }
+
+    void TestGenerations() {
+        HandleTable table;
+        uint32_t slot = 0;
+        uint32_t resolved = 0;
+        std::string error;
+        CHECK(table.Allocate(1, slot, error));
+        uint32_t id = table.Id(slot);
+        CHECK(table.Resolve(id, 1, resolved) && resolved == slot);
+        CHECK(!table.Resolve(id, 2, resolved));
+        CHECK(table.LiveCount() == 1);
+
+        table.Release(slot);
+        CHECK(!table.Resolve(id, 1, resolved));
+        CHECK(table.LiveCount() == 0);
+
+        // The slot is reused under a new generation; the old id stays dead.
+        uint32_t reused = 0;
+        CHECK(table.Allocate(1, reused, error) && reused == slot);
+        CHECK(table.Id(reused) != id);
+        CHECK(!table.Resolve(id, 1, resolved));
+        CHECK(table.Resolve(table.Id(reused), 1, resolved));
+
+        // Generation 0 is skipped when the counter wraps, so id 0 never resolves.
+        for (int i = 0; i < 70000; i++) {
+            table.Release(reused);
+            table.Allocate(1, reused, error);
+            CHECK(table.Id(reused) >> 16 != 0);
+        }
+        CHECK(!table.Resolve(0, 1, resolved));
+    }
+
+    void TestLimits() {
+        HandleTable table(2);
+        uint32_t slot = 0;
+        std::string error;
+        CHECK(table.Allocate(1, slot, error));
+        CHECK(table.Allocate(1, slot, error));
+        CHECK(!table.Allocate(1, slot, error));
+        CHECK(error.find("limit of 2") != std::string::npos);
+        CHECK(table.Allocate(2, slot, error));
+        CHECK(table.SessionSlots(1).size() == 2);
+        CHECK(table.LiveSlots().size() == 3);
+
+        HandleTable full(HandleTable::MaxSlots + 1);
+        for (uint32_t i = 0; i < HandleTable::MaxSlots; i++) {
+            full.Allocate(1, slot, error);
+        }
+        CHECK(full.LiveCount() == HandleTable::MaxSlots);
+        error.clear();
+        CHECK(!full.Allocate(1, slot, error));
+        CHECK(error == "Handle table is full");
+    }
+
+    void TestParseId() {
+        uint32_t id = 0;
+        CHECK(HandleTable::ParseId("65536", id) && id == 65536);
+        CHECK(HandleTable::ParseId("4294967295", id) && id == 4294967295u);
+        const char* rejected[] = { "", "-1", " 1", "1 ", "+1", "0x10", "4294967296", "99999999999" };
+        for (const char* text : rejected) {
+            CHECK(!HandleTable::ParseId(text, id));
+        }
+    }
+
+    void TestRewriteReferences() {
+        HandleTable table;
+        uint32_t slot = 0;
+        std::string error;
+        table.Allocate(1, slot, error);
+        uint32_t id = table.Id(slot);
+        std::string name = HandleTable::VariableName(slot);
+
+        std::string instruction = WithToken("ID.getName() + ID", id);
+        CHECK(table.RewriteReferences(instruction, 1, error));
+        CHECK(instruction == name + ".getName() + " + name);
+
+        // Literals and comments are left as written.
+        const char* untouched[] = { "\"ID\"", "\"\\\"ID\"", "'\\'' // ID it's\n", "/* ID */" };
+        for (const char* text : untouched) {
+            std::string literal = WithToken(text, id);
+            instruction = literal + WithToken(" + ID", id);
+            CHECK(table.RewriteReferences(instruction, 1, error));
+            CHECK(instruction == literal + " + " + name);
+        }
+
+        instruction = WithToken("ID", id);
+        CHECK(!table.RewriteReferences(instruction, 2, error));
+        instruction = "$h{-1}.size()";
+        CHECK(!table.RewriteReferences(instruction, 1, error));
+        CHECK(error == "Invalid or released handle $h{-1}");
+        instruction = "$h{ " + std::to_string(id) + "}";
+        CHECK(!table.RewriteReferences(instruction, 1, error));
+    }
+}
+
+int main() {
+    TestGenerations();
+    TestLimits();
+    TestParseId();
+    TestRewriteReferences();
+    return CheckFailures() == 0 ? 0 : 1;
+}
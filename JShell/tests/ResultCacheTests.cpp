@@ -0,0 +1,121 @@
+#include "pch.h"
+#include "ResultCache.hpp"
+#include "Check.hpp"
+#include <chrono>
+#include <string>
+
+// Unit tests for ResultCache: policy parsing, keys, LRU eviction, TTL and tick expiry.
+// Needs neither a JVM nor JNI headers.
+
+namespace {
+    typedef std::chrono::steady_clock Clock;
+
+    CachePolicy Tick() {
+        CachePolicy policy;
+        policy.enabled = true;
+        return policy;
+    }
+
+    CachePolicy Timed(uint32_t millis) {
+        CachePolicy policy;
+        policy.enabled = true;
+        policy.ttlMillis = millis;
+        return policy;
+    }
+
+    void TestParsePolicy() {
+        std::string instruction = "<CACHE>client.getTickCount();";
+        CachePolicy policy = ResultCache::ParsePolicy(instruction);
+        CHECK(policy.enabled && policy.ttlMillis == 0);
+        CHECK(instruction == "client.getTickCount();");
+
+        instruction = "<CACHE=250>1;";
+        policy = ResultCache::ParsePolicy(instruction);
+        CHECK(policy.enabled && policy.ttlMillis == 250);
+        CHECK(instruction == "1;");
+
+        const char* rejected[] = { "<CACHE=0>1;", "<CACHE=>1;", "<CACHE=5x>1;", "<CACHE 1;", "1;" };
+        for (const char* text : rejected) {
+            instruction = text;
+            CHECK(!ResultCache::ParsePolicy(instruction).enabled);
+            CHECK(instruction == text);
+        }
+    }
+
+    void TestKey() {
+        CHECK(ResultCache::Key("a  +\n b;", 1) == ResultCache::Key("a + b", 2));
+        CHECK(ResultCache::Key("\"a  b\"", 1) != ResultCache::Key("\"a b\"", 1));
+        // Handle ids only resolve in their own session.
+        CHECK(ResultCache::Key("$h{65536}.size()", 1) != ResultCache::Key("$h{65536}.size()", 2));
+        CHECK(ResultCache::Key("release $h{65536};", 1).empty());
+        CHECK(ResultCache::Key("<HANDLE>client", 1).empty());
+        CHECK(ResultCache::Key("<PIN>int x = 1;", 1).empty());
+        CHECK(ResultCache::Key("cleanup;", 1).empty());
+    }
+
+    void TestLeastRecentlyUsed() {
+        // Each entry below takes 2 * 2 + 100 + overhead bytes; five fit.
+        Clock::time_point now = Clock::now();
+        std::string value(100, 'v');
+        ResultCache cache(1000);
+        for (int i = 1; i <= 5; i++) {
+            cache.Store("k" + std::to_string(i), value, Timed(60000), -1, now);
+        }
+        std::string response;
+        CHECK(cache.Lookup("k1", -1, now, response) && response == value);
+
+        cache.Store("k6", value, Timed(60000), -1, now);
+        CHECK(!cache.Lookup("k2", -1, now, response));
+        CHECK(cache.Lookup("k1", -1, now, response));
+        CHECK(cache.Lookup("k6", -1, now, response));
+        CHECK(cache.Stats().find("evictions=1") != std::string::npos);
+
+        // An entry larger than a quarter of the capacity is not kept at all.
+        cache.Store("big", std::string(300, 'v'), Timed(60000), -1, now);
+        CHECK(!cache.Lookup("big", -1, now, response));
+    }
+
+    void TestTimeToLive() {
+        Clock::time_point now = Clock::now();
+        ResultCache cache;
+        std::string response;
+        cache.Store("k", "1", Timed(100), -1, now);
+        CHECK(cache.Lookup("k", -1, now + std::chrono::milliseconds(99), response) && response == "1");
+        CHECK(!cache.Lookup("k", -1, now + std::chrono::milliseconds(100), response));
+        // The stale entry was dropped, not just skipped.
+        CHECK(!cache.Lookup("k", -1, now, response));
+        CHECK(cache.Stats().find("expirations=1") != std::string::npos);
+    }
+
+    void TestTickScoped() {
+        Clock::time_point now = Clock::now();
+        ResultCache cache;
+        std::string response;
+        cache.Store("k", "1", Tick(), 7, now);
+        CHECK(cache.Lookup("k", 7, now, response) && response == "1");
+        CHECK(!cache.Lookup("k", 8, now, response));
+
+        // A counter that stops advancing does not keep the entry alive.
+        const uint32_t maxAge = ResultCache::TickMaxAgeMillis;
+        cache.Store("k", "1", Tick(), 7, now);
+        CHECK(cache.Lookup("k", 7, now + std::chrono::milliseconds(maxAge - 1), response));
+        CHECK(!cache.Lookup("k", 7, now + std::chrono::milliseconds(maxAge), response));
+
+        // Without a tick counter there is nothing to scope the entry to.
+        cache.Store("unknown", "1", Tick(), -1, now);
+        CHECK(!cache.Lookup("unknown", -1, now, response));
+
+        cache.Store("k", "1", Tick(), 7, now);
+        cache.Clear();
+        CHECK(!cache.Lookup("k", 7, now, response));
+    }
+}
+
+int main() {
+    TestParsePolicy();
+    TestKey();
+    TestLeastRecentlyUsed();
+    TestTimeToLive();
+    TestTickScoped();
+    return CheckFailures() == 0 ? 0 : 1;
+}
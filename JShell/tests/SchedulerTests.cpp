@@ -0,0 +1,119 @@
+#include "pch.h"
+#include "Scheduler.hpp"
+#include "Check.hpp"
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Unit tests for the Scheduler's lane selection (weighting, starvation, strict mode) and for
+// requests submitted while it is stopped. No evaluator thread is started, so no JVM is needed.
+
+class SchedulerTest {
+public:
+    static void Push(Scheduler& scheduler, Priority priority) {
+        std::unique_ptr<Request> request(new Request());
+        request->priority = priority;
+        request->session = 1;
+        request->enqueued = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(scheduler.mtx);
+        scheduler.lanes[static_cast<size_t>(priority)].push_back(std::move(request));
+    }
+
+    // The lanes the next `count` dispatches come from, 'i' / 'b', '-' once nothing is left.
+    static std::string Order(Scheduler& scheduler, size_t count) {
+        std::string order;
+        std::lock_guard<std::mutex> lock(scheduler.mtx);
+        for (size_t i = 0; i < count; i++) {
+            std::unique_ptr<Request> request = scheduler.Next();
+            order += !request ? '-' : request->priority == Priority::Interactive ? 'i' : 'b';
+        }
+        return order;
+    }
+};
+
+namespace {
+    void Fill(Scheduler& scheduler, size_t interactive, size_t bulk) {
+        for (size_t i = 0; i < interactive; i++) {
+            SchedulerTest::Push(scheduler, Priority::Interactive);
+        }
+        for (size_t i = 0; i < bulk; i++) {
+            SchedulerTest::Push(scheduler, Priority::Bulk);
+        }
+    }
+
+    void TestWeighted() {
+        // Four interactive dispatches to every bulk one, interleaved rather than in bursts.
+        Scheduler scheduler;
+        Fill(scheduler, 8, 4);
+        CHECK(SchedulerTest::Order(scheduler, 10) == "iibiiiibii");
+        CHECK(SchedulerTest::Order(scheduler, 3) == "bb-");
+
+        Scheduler even;
+        even.SetWeight(Priority::Bulk, 4);
+        Fill(even, 4, 4);
+        CHECK(SchedulerTest::Order(even, 8) == "ibibibib");
+
+        // A weight of zero is raised to one, so no lane can be shut out.
+        Scheduler lowered;
+        lowered.SetWeight(Priority::Bulk, 0);
+        lowered.SetWeight(Priority::Interactive, 1);
+        Fill(lowered, 2, 2);
+        CHECK(SchedulerTest::Order(lowered, 4) == "ibib");
+    }
+
+    void TestNoStarvation() {
+        // Interactive traffic that never lets up still leaves bulk one slot in five.
+        Scheduler scheduler;
+        Fill(scheduler, 1, 100);
+        size_t bulk = 0;
+        for (int i = 0; i < 100; i++) {
+            SchedulerTest::Push(scheduler, Priority::Interactive);
+            bulk += SchedulerTest::Order(scheduler, 1) == "b" ? 1 : 0;
+        }
+        CHECK(bulk == 20);
+    }
+
+    void TestStrict() {
+        Scheduler scheduler(DispatchMode::Strict);
+        Fill(scheduler, 3, 2);
+        CHECK(SchedulerTest::Order(scheduler, 6) == "iiibb-");
+    }
+
+    void TestTickLaneNotDispatched() {
+        // Tick requests are served together once per tick, never one by one.
+        Scheduler scheduler;
+        SchedulerTest::Push(scheduler, Priority::Tick);
+        CHECK(SchedulerTest::Order(scheduler, 1) == "-");
+        CHECK(scheduler.Queued() == 1);
+    }
+
+    void TestSubmitWhileStopped() {
+        Scheduler scheduler;
+        std::future<std::string> response = scheduler.Submit("1;", Priority::Interactive, 1);
+        CHECK(response.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+        CHECK(ErrorInfo::IsError(response.get()));
+        CHECK(scheduler.Queued() == 0);
+    }
+
+    void TestParsePriority() {
+        std::string instruction = "<PRI=bulk>1;";
+        Priority priority = Priority::Interactive;
+        CHECK(Scheduler::ParsePriority(instruction, priority) && priority == Priority::Bulk && instruction == "1;");
+        instruction = "<PRI=tick>1;";
+        CHECK(Scheduler::ParsePriority(instruction, priority) && priority == Priority::Tick);
+        instruction = "1;";
+        CHECK(Scheduler::ParsePriority(instruction, priority) && priority == Priority::Interactive);
+        instruction = "<PRI=urgent>1;";
+        CHECK(!Scheduler::ParsePriority(instruction, priority) && instruction == "<PRI=urgent>1;");
+    }
+}
+
+int main() {
+    TestWeighted();
+    TestNoStarvation();
+    TestStrict();
+    TestTickLaneNotDispatched();
+    TestSubmitWhileStopped();
+    TestParsePriority();
+    return CheckFailures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,84 @@
+"""Smoke test for jshell-host, run by ctest: starts the host on a private socket, drives a
+few requests through asyncremoteapi and checks that it shuts down cleanly.
+
+    python host_smoke.py path/to/jshell-host
+
+asyncremoteapi must be importable (ctest puts the repository root on PYTHONPATH).
+"""
+import asyncio
+import os
+import shutil
+import signal
+import subprocess
+import sys
+import tempfile
+import time
+
+from asyncremoteapi import AsyncRemoteAPI, JShellError
+
+STARTUP_SECONDS = 60
+
+
+async def exercise(endpoint):
+    async with AsyncRemoteAPI(endpoint) as api:
+        assert await api.query("1 + 1") == "2"
+
+        # Many requests in flight on one connection, answered by id.
+        results = await asyncio.gather(*(api.query(f"{i} * 3", "bulk") for i in range(20)))
+        assert results == [str(i * 3) for i in range(20)], results
+
+        handle = await api.handle('new StringBuilder("smoke")')
+        assert await api.query(f"{handle}.length()") == "5"
+        assert await api.query(f'"{handle}"') == f'"{handle}"'  # literals are not rewritten
+        await api.release(handle)
+        try:
+            await api.query(f"{handle}.length()")
+            raise AssertionError("a released handle still resolved")
+        except JShellError:
+            pass
+
+        try:
+            await api.query('throw new IllegalStateException("smoke")')
+            raise AssertionError("an exception was not reported")
+        except JShellError as e:
+            assert e.exception_class and "IllegalStateException" in e.exception_class, e
+
+        stats = await api.query("stats")
+        assert "lane=interactive" in stats and "cache entries=" in stats, stats
+
+
+def main():
+    host = sys.argv[1]
+    directory = tempfile.mkdtemp()
+    endpoint = os.path.join(directory, "jshell-smoke.sock")
+    process = subprocess.Popen([host, endpoint])
+    try:
+        deadline = time.monotonic() + STARTUP_SECONDS
+        while not os.path.exists(endpoint):
+            if process.poll() is not None:
+                print(f"jshell-host exited with {process.returncode} before serving", file=sys.stderr)
+                return 1
+            if time.monotonic() > deadline:
+                print("jshell-host did not start serving", file=sys.stderr)
+                return 1
+            time.sleep(0.1)
+
+        asyncio.run(exercise(endpoint))
+    finally:
+        if process.poll() is None:
+            process.send_signal(signal.SIGTERM)
+        try:
+            process.wait(timeout=30)
+        except subprocess.TimeoutExpired:
+            process.kill()
+            process.wait()
+        shutil.rmtree(directory, ignore_errors=True)
+    if process.returncode != 0:
+        print(f"jshell-host exited with {process.returncode}", file=sys.stderr)
+        return 1
+    print("jshell-host smoke test passed")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,459 @@
+"""asyncio client for the JShell server.
+
+Keeps one persistent connection open, speaks the framed protocol negotiated with the
+"READY_FRAMED" handshake and lets any number of queries be in flight at once; responses
+are matched to their requests by id. On Windows the connection is an overlapped named pipe
+(ProactorEventLoop); elsewhere it is a Unix domain socket, which is what the headless host
+serves and what tests on Linux connect to.
+
+Every game client serves its own endpoint ("jshellpipe-<pid>") and lists it in a registry
+shared by all servers on the machine; discover() reads it and AsyncFleet sends a query to
+all of them at once.
+
+This module has no SynapseScape dependencies so it can be used on its own.
+"""
+import asyncio
+import itertools
+import os
+import re
+import struct
+import sys
+import tempfile
+import threading
+import time
+from typing import NamedTuple
+
+HANDSHAKE_READY = "READY_FRAMED"
+HANDSHAKE_GO_AHEAD = "GO_AHEAD_FRAMED"
+TERMINATOR = b"<END>"
+
+# length, id, flags -- little-endian, mirrors FrameHeader in Pipeline.hpp
+FRAME_HEADER = struct.Struct("<III")
+FRAME_FLAG_ERROR = 0x1
+
+# Mirrors ErrorInfo::Format in Errors.hpp
+ERROR_PREFIX = "<ERROR>"
+ERROR_FIELD_SEPARATOR = "\x1f"
+
+# Mirrors RegistryHeader / RegistrySlot in EndpointRegistry.hpp
+REGISTRY_HEADER = struct.Struct("<4sIII")
+REGISTRY_SLOT = struct.Struct("<IIQQIIQ216s")
+REGISTRY_MAGIC = b"JSRG"
+REGISTRY_VERSION = 1
+REGISTRY_STALE_MILLIS = 10000
+STATUS_READY = 2
+STATUS_NAMES = {0: "free", 1: "starting", 2: "ready", 3: "stopping"}
+
+
+def endpoint_for_pid(pid: int) -> str:
+    """The endpoint the server injected into process pid listens on (see DefaultEndpoint
+    in Platform.hpp)."""
+    if sys.platform == "win32":
+        return rf"\\.\pipe\jshellpipe-{pid}"
+    return f"/tmp/jshellpipe-{pid}.sock"
+
+
+def registry_path():
+    path = os.environ.get("JSHELL_REGISTRY")
+    if path:
+        return path
+    if sys.platform == "win32":
+        return os.path.join(tempfile.gettempdir(), "jshell-registry")
+    return os.path.join(os.environ.get("TMPDIR") or "/tmp", "jshell-registry")
+
+
+def _process_alive(pid):
+    if sys.platform == "win32":
+        import ctypes
+        kernel32 = ctypes.windll.kernel32
+        handle = kernel32.OpenProcess(0x00100000, False, pid)  # SYNCHRONIZE
+        if not handle:
+            return kernel32.GetLastError() == 5  # ERROR_ACCESS_DENIED: someone else's process
+        try:
+            return kernel32.WaitForSingleObject(handle, 0) == 0x102  # WAIT_TIMEOUT
+        finally:
+            kernel32.CloseHandle(handle)
+    try:
+        os.kill(pid, 0)
+    except ProcessLookupError:
+        return False
+    except PermissionError:
+        pass
+    return True
+
+
+class EndpointInfo(NamedTuple):
+    """A server listed in the registry. connections and queued are its current load,
+    served counts requests evaluated since it started."""
+    pid: int
+    status: str
+    endpoint: str
+    started: float  # Unix time
+    heartbeat_age: float  # seconds since the server last published its load
+    connections: int
+    queued: int
+    served: int
+
+
+def discover(include_stale=False):
+    """Servers on this machine that are accepting connections, oldest first. With
+    include_stale, every claimed slot is returned, whatever state its server is in."""
+    try:
+        with open(registry_path(), "rb") as f:
+            data = f.read()
+    except FileNotFoundError:
+        return []
+    if len(data) < REGISTRY_HEADER.size:
+        return []
+    magic, version, slot_count, slot_size = REGISTRY_HEADER.unpack_from(data)
+    if magic != REGISTRY_MAGIC or version != REGISTRY_VERSION or slot_size != REGISTRY_SLOT.size:
+        return []
+
+    now = time.time() * 1000
+    servers = []
+    for i in range(slot_count):
+        offset = REGISTRY_HEADER.size + i * slot_size
+        if offset + slot_size > len(data):
+            break
+        pid, status, started, heartbeat, connections, queued, served, endpoint = REGISTRY_SLOT.unpack_from(data, offset)
+        if pid == 0:
+            continue
+        live = status == STATUS_READY and now - heartbeat <= REGISTRY_STALE_MILLIS and _process_alive(pid)
+        if not (live or include_stale):
+            continue
+        servers.append(EndpointInfo(pid, STATUS_NAMES.get(status, str(status)),
+                                    endpoint.split(b"\0", 1)[0].decode("utf-8", "replace"),
+                                    started / 1000, max(0.0, (now - heartbeat) / 1000),
+                                    connections, queued, served))
+    servers.sort(key=lambda server: server.started)
+    return servers
+
+
+def default_endpoint():
+    """JSHELL_ENDPOINT if set, otherwise the most recently started server on this machine,
+    or None if there is none."""
+    endpoint = os.environ.get("JSHELL_ENDPOINT")
+    if endpoint:
+        return endpoint
+    servers = discover()
+    return servers[-1].endpoint if servers else None
+
+
+class PipeNotOpenError(Exception):
+    """Raised when the pipe is not open for operations."""
+
+    def __init__(self, message, data=None):
+        self.message = message
+        self.data = data  # Store additional data causing the issue
+
+    def __str__(self):
+        return f"{self.message}. Data causing the error: {self.data}"
+
+
+class JShellError(Exception):
+    """A query failed on the server. code and name say why (see ErrorCode in Errors.hpp);
+    exception_class and stack are set when Java threw."""
+
+    def __init__(self, payload: str):
+        self.payload = payload
+        fields = payload[len(ERROR_PREFIX):].split(ERROR_FIELD_SEPARATOR, 4)
+        fields += [""] * (5 - len(fields))
+        code, self.name, self.exception_class, self.message, self.stack = fields
+        self.code = int(code) if code.isdigit() else 0
+        super().__init__(str(self))
+
+    @staticmethod
+    def is_error(payload: str) -> bool:
+        return payload.startswith(ERROR_PREFIX)
+
+    def __str__(self):
+        if self.exception_class:
+            return f"{self.name}: {self.exception_class}: {self.message}"
+        return f"{self.name}: {self.message}"
+
+
+class Handle:
+    """Server-side reference to an object returned by a query. Interpolate it into later
+    queries (str(handle) is the "$h{id}" token the server understands) to use the object
+    as a receiver or argument without navigating to it again."""
+
+    token = re.compile(r"\$h\{(\d+)\}")
+
+    def __init__(self, handle_id: int):
+        self.id = handle_id
+
+    def __str__(self):
+        return f"$h{{{self.id}}}"
+
+    def __repr__(self):
+        return f"Handle({self.id})"
+
+
+class AsyncRemoteAPI:
+    def __init__(self, endpoint=None, encoding='utf-8', connect_retries=20):
+        # Without an endpoint, connect() keeps looking for a server until one registers.
+        self.endpoint = endpoint
+        self.encoding = encoding
+        self.connect_retries = connect_retries
+        self.reader = None
+        self.writer = None
+        self.pending = {}
+        self.ids = itertools.count(1)
+        self.reader_task = None
+
+    async def _open(self, endpoint):
+        if sys.platform == "win32":
+            loop = asyncio.get_running_loop()
+            reader = asyncio.StreamReader()
+            protocol = asyncio.StreamReaderProtocol(reader)
+            transport, _ = await loop.create_pipe_connection(lambda: protocol, endpoint)
+            writer = asyncio.StreamWriter(transport, protocol, reader, loop)
+            return reader, writer
+        return await asyncio.open_unix_connection(endpoint)
+
+    async def connect(self):
+        if self.writer:
+            return self
+        last_error = None
+        for _ in range(self.connect_retries):
+            endpoint = self.endpoint or default_endpoint()
+            try:
+                if not endpoint:
+                    raise FileNotFoundError(f"No server registered in {registry_path()}")
+                self.reader, self.writer = await self._open(endpoint)
+                self.endpoint = endpoint
+                break
+            except (FileNotFoundError, ConnectionRefusedError, OSError) as e:
+                # "All pipe instances are busy" and a listener between instances both resolve quickly
+                last_error = e
+                await asyncio.sleep(0.1)
+        else:
+            raise PipeNotOpenError(f"Could not open pipe after {self.connect_retries} retries", self.endpoint) from last_error
+
+        self.writer.write(HANDSHAKE_READY.encode(self.encoding) + TERMINATOR)
+        await self.writer.drain()
+        response = (await self.reader.readuntil(TERMINATOR))[:-len(TERMINATOR)].decode(self.encoding)
+        if response != HANDSHAKE_GO_AHEAD:
+            await self.close()
+            raise PipeNotOpenError("Handshake failed. Expected GO_AHEAD_FRAMED", response)
+
+        self.reader_task = asyncio.ensure_future(self._read_responses())
+        return self
+
+    async def _read_responses(self):
+        try:
+            while True:
+                header = await self.reader.readexactly(FRAME_HEADER.size)
+                length, request_id, flags = FRAME_HEADER.unpack(header)
+                payload = await self.reader.readexactly(length)
+                future = self.pending.pop(request_id, None)
+                if future and not future.done():
+                    try:
+                        text = payload.decode(self.encoding)
+                    except UnicodeDecodeError as e:
+                        # The whole frame was read, so only this response is lost.
+                        future.set_exception(e)
+                        continue
+                    if flags & FRAME_FLAG_ERROR:
+                        future.set_exception(JShellError(text))
+                    else:
+                        future.set_result(text)
+        except (asyncio.IncompleteReadError, ConnectionError) as e:
+            error = PipeNotOpenError("Connection closed", self.endpoint)
+            error.__cause__ = e
+        except asyncio.CancelledError:
+            error = PipeNotOpenError("Connection closed", self.endpoint)
+        except Exception as e:
+            # Anything else still ends the reader; no query may be left waiting on it.
+            error = PipeNotOpenError("Connection closed", self.endpoint)
+            error.__cause__ = e
+        for future in self.pending.values():
+            if not future.done():
+                future.set_exception(error)
+        self.pending.clear()
+        self.writer = None
+
+    async def query(self, script: str, priority: str = None, cache=None) -> str:
+        """Evaluate a snippet. priority is "interactive" (default), "bulk", or "tick" to have
+        the expression evaluated at the start of the next game tick together with every other
+        "tick" query, in one pass on the client thread. Raises JShellError if the snippet
+        threw, did not compile or the server could not run it, and for any other priority.
+        How the server shares out the lanes is set with the "scheduler mode strict|weighted"
+        and "scheduler weight interactive|bulk <n>" commands.
+
+        cache lets the server answer a side-effect-free read from its result cache: "tick"
+        reuses a result until the game tick advances (at most two seconds), a number of
+        seconds reuses it for that long. Failures are never cached."""
+        assert isinstance(script, str)
+        if not self.writer:
+            await self.connect()
+        if not script.endswith(';'):
+            script += ';'
+        if cache == "tick":
+            script = "<CACHE>" + script
+        elif cache:
+            script = f"<CACHE={max(1, round(cache * 1000))}>" + script
+        if priority:
+            script = f"<PRI={priority}>" + script
+
+        request_id = next(self.ids) & 0xFFFFFFFF
+        payload = script.encode(self.encoding)
+        future = asyncio.get_running_loop().create_future()
+        self.pending[request_id] = future
+        self.writer.write(FRAME_HEADER.pack(len(payload), request_id, 0) + payload)
+        await self.writer.drain()
+        return await future
+
+    async def handle(self, script: str, priority: str = None) -> Handle:
+        """Evaluate an expression and keep its result on the server as a Handle."""
+        response = await self.query("<HANDLE>" + script, priority)
+        match = Handle.token.fullmatch(response)
+        if not match:
+            raise ValueError(f"Could not create handle: {response}")
+        return Handle(int(match.group(1)))
+
+    async def release(self, handle: Handle):
+        """Handles are released automatically on disconnect; release early to stay under the
+        per-session limit."""
+        response = await self.query(f"release {handle}")
+        if response != "released":
+            raise ValueError(response)
+
+    async def close(self):
+        if self.reader_task:
+            self.reader_task.cancel()
+            try:
+                await self.reader_task
+            except asyncio.CancelledError:
+                pass
+            self.reader_task = None
+        if self.writer:
+            self.writer.close()
+            self.writer = None
+
+    async def __aenter__(self):
+        return await self.connect()
+
+    async def __aexit__(self, exc_type, exc_value, traceback):
+        await self.close()
+
+
+class SyncRemoteAPI:
+    """Blocking facade over AsyncRemoteAPI. The event loop runs on a daemon thread, so calls
+    from any number of threads share the one connection and are pipelined on it."""
+
+    def __init__(self, endpoint=None, encoding='utf-8'):
+        if sys.platform == "win32":
+            self.loop = asyncio.ProactorEventLoop()
+        else:
+            self.loop = asyncio.new_event_loop()
+        self.thread = threading.Thread(target=self.loop.run_forever, daemon=True)
+        self.thread.start()
+        self.client = AsyncRemoteAPI(endpoint, encoding)
+        self._call(self.client.connect())
+
+    def _call(self, coroutine):
+        return asyncio.run_coroutine_threadsafe(coroutine, self.loop).result()
+
+    def query(self, script: str, priority: str = None, cache=None) -> str:
+        return self._call(self.client.query(script, priority, cache))
+
+    def handle(self, script: str, priority: str = None) -> Handle:
+        return self._call(self.client.handle(script, priority))
+
+    def release(self, handle: Handle):
+        return self._call(self.client.release(handle))
+
+    def submit(self, script: str, priority: str = None, cache=None):
+        """Send without waiting; returns a concurrent.futures.Future."""
+        return asyncio.run_coroutine_threadsafe(self.client.query(script, priority, cache), self.loop)
+
+    def close(self):
+        self._call(self.client.close())
+        self.loop.call_soon_threadsafe(self.loop.stop)
+        self.thread.join()
+
+
+class AsyncFleet:
+    """One connection to each server on the machine (every registered one, or the given
+    endpoints); a query runs on all of them concurrently.
+
+        async with AsyncFleet() as fleet:
+            ticks = await fleet.query("client.getTickCount()")
+
+    Results are keyed by endpoint; discover() maps endpoints to pids."""
+
+    def __init__(self, endpoints=None, encoding='utf-8'):
+        self.endpoints = list(endpoints) if endpoints else None
+        self.encoding = encoding
+        self.clients = {}
+
+    async def refresh(self):
+        """Connects to servers that have registered since the last call and drops the ones
+        that are gone. Returns the endpoints now connected."""
+        wanted = self.endpoints or [server.endpoint for server in discover()]
+        for endpoint in [endpoint for endpoint in self.clients if endpoint not in wanted]:
+            await self.clients.pop(endpoint).close()
+
+        new = [endpoint for endpoint in wanted if endpoint not in self.clients]
+        connected = await asyncio.gather(*(AsyncRemoteAPI(endpoint, self.encoding, connect_retries=1).connect()
+                                           for endpoint in new), return_exceptions=True)
+        for endpoint, client in zip(new, connected):
+            if isinstance(client, AsyncRemoteAPI):
+                self.clients[endpoint] = client
+        return list(self.clients)
+
+    async def query(self, script: str, priority: str = None) -> dict:
+        """Evaluate script on every server. Maps each endpoint to its result, or to the
+        exception its query raised (JShellError, PipeNotOpenError); one failing server does
+        not fail the others."""
+        if not self.clients:
+            await self.refresh()
+        endpoints = list(self.clients)
+        results = await asyncio.gather(*(self.clients[endpoint].query(script, priority) for endpoint in endpoints),
+                                       return_exceptions=True)
+        for endpoint, result in zip(endpoints, results):
+            if isinstance(result, PipeNotOpenError):
+                # The server went away; refresh() reconnects if it comes back.
+                await self.clients.pop(endpoint).close()
+        return dict(zip(endpoints, results))
+
+    async def close(self):
+        for client in self.clients.values():
+            await client.close()
+        self.clients.clear()
+
+    async def __aenter__(self):
+        await self.refresh()
+        return self
+
+    async def __aexit__(self, exc_type, exc_value, traceback):
+        await self.close()
+
+
+class SyncFleet:
+    """Blocking facade over AsyncFleet, run on a daemon event loop like SyncRemoteAPI."""
+
+    def __init__(self, endpoints=None, encoding='utf-8'):
+        if sys.platform == "win32":
+            self.loop = asyncio.ProactorEventLoop()
+        else:
+            self.loop = asyncio.new_event_loop()
+        self.thread = threading.Thread(target=self.loop.run_forever, daemon=True)
+        self.thread.start()
+        self.fleet = AsyncFleet(endpoints, encoding)
+        self._call(self.fleet.refresh())
+
+    def _call(self, coroutine):
+        return asyncio.run_coroutine_threadsafe(coroutine, self.loop).result()
+
+    def refresh(self):
+        return self._call(self.fleet.refresh())
+
+    def query(self, script: str, priority: str = None) -> dict:
+        return self._call(self.fleet.query(script, priority))
+
+    def close(self):
+        self._call(self.fleet.close())
+        self.loop.call_soon_threadsafe(self.loop.stop)
+        self.thread.join()
@@ -0,0 +1,167 @@
+"""Read game frames captured by a JShell server into shared memory.
+
+The server copies the client's frame into a file at game rate once asked to ("capture
+start [<x> <y> <width> <height>] <path>" / "capture stop"; see FrameCapture.hpp for the
+layout). Readers map the file and pick frames up without any pipe traffic; a frame is only
+published when its pixels changed, and says which part of it did. Restarting the capture
+reuses the file in place, so a reader can stay open across it.
+
+    api.query("capture start 0 0 512 334 /tmp/frames")
+    with FrameReader("/tmp/frames") as frames:
+        frame = frames.wait(timeout=1)
+        r, g, b = frame.pixel(100, 100)
+        image = frame.to_image()        # needs Pillow
+
+    python framecapture.py /tmp/frames                   # print frames as they arrive
+    python framecapture.py /tmp/frames --save last.png   # save the latest one
+
+Runs headless on Linux and has no SynapseScape dependencies.
+"""
+import argparse
+import mmap
+import struct
+import sys
+import time
+from typing import NamedTuple, Optional, Tuple
+
+# Mirrors FrameFileHeader / FrameBufferHeader in FrameCapture.hpp
+FILE_HEADER = struct.Struct("<4sIIIIIIIQ24x")
+BUFFER_HEADER = struct.Struct("<QQQiIIIIIIIIII28x")
+MAGIC = b"JSFC"
+VERSION = 1
+
+# Attempts at copying a frame the writer keeps overwriting before giving up.
+READ_ATTEMPTS = 100
+
+
+class Frame(NamedTuple):
+    """One captured frame. x, y, width and height are the region of the game frame held in
+    pixels (4 bytes per pixel, B G R 0, rows top to bottom); changed is the bounding box of
+    what differs from the previous frame, relative to the region."""
+    number: int
+    captured: float  # Unix time
+    tick: int  # client tick counter, -1 if unknown
+    frame_width: int
+    frame_height: int
+    x: int
+    y: int
+    width: int
+    height: int
+    changed: Tuple[int, int, int, int]
+    pixels: bytes
+
+    def pixel(self, x, y):
+        """(r, g, b) at (x, y) in game frame coordinates."""
+        if not (self.x <= x < self.x + self.width and self.y <= y < self.y + self.height):
+            raise IndexError(f"({x}, {y}) is outside the captured region")
+        offset = ((y - self.y) * self.width + (x - self.x)) * 4
+        b, g, r = self.pixels[offset:offset + 3]
+        return r, g, b
+
+    def to_image(self):
+        """The frame as a Pillow RGB image."""
+        from PIL import Image
+        return Image.frombuffer("RGB", (self.width, self.height), self.pixels, "raw", "BGRX", 0, 1)
+
+
+class FrameReader:
+    def __init__(self, path):
+        self.file = open(path, "rb")
+        self.map = mmap.mmap(self.file.fileno(), 0, access=mmap.ACCESS_READ)
+        if not self._load():
+            self.close()
+            raise ValueError(f"{path} is not a version {VERSION} frame capture")
+        self.last = 0
+
+    def _load(self):
+        """Reads the layout, which a restarted capture may have changed; False while the
+        file is not (or not yet again) a capture."""
+        magic, version, self.buffer_count, self.buffer_size, self.max_width, self.max_height, \
+            _, self.interval_millis, _ = FILE_HEADER.unpack_from(self.map)
+        return magic == MAGIC and version == VERSION
+
+    def published(self):
+        """Frames published so far. Drops back to 0 when the capture is restarted."""
+        return FILE_HEADER.unpack_from(self.map)[8]
+
+    def latest(self) -> Optional[Frame]:
+        """The most recent frame, or None if none has been published yet."""
+        for _ in range(READ_ATTEMPTS):
+            published = self.published()
+            if published == 0 or not self._load():
+                return None
+            front = FILE_HEADER.unpack_from(self.map)[6]
+            offset = FILE_HEADER.size + front * self.buffer_size
+            if offset + self.buffer_size > len(self.map):
+                # A restart grew the file for a larger region.
+                self.map.close()
+                self.map = mmap.mmap(self.file.fileno(), 0, access=mmap.ACCESS_READ)
+                continue
+            sequence, number, micros, tick, frame_width, frame_height, x, y, width, height, cx, cy, cw, ch = \
+                BUFFER_HEADER.unpack_from(self.map, offset)
+            if sequence & 1:
+                continue
+            length = width * height * 4
+            start = offset + BUFFER_HEADER.size
+            pixels = self.map[start:start + length]
+            # The copy is good if the writer did not touch the buffer meanwhile.
+            if struct.unpack_from("<Q", self.map, offset)[0] != sequence or self.published() < published:
+                continue
+            if len(pixels) != length:
+                raise ValueError(f"frame {number} claims {width}x{height} pixels, more than its buffer holds")
+            self.last = number
+            return Frame(number, micros / 1e6, tick, frame_width, frame_height, x, y, width, height,
+                         (cx, cy, cw, ch), pixels)
+        raise RuntimeError("frame capture is changing too fast to read")
+
+    def wait(self, timeout=None) -> Optional[Frame]:
+        """The next frame newer than the last one returned, or None after timeout seconds."""
+        deadline = None if timeout is None else time.monotonic() + timeout
+        poll = self.interval_millis / 4000
+        while True:
+            published = self.published()
+            if published < self.last:
+                # The capture was restarted and numbers its frames from 1 again.
+                self.last = 0
+            if published > self.last:
+                break
+            if deadline is not None and time.monotonic() >= deadline:
+                return None
+            time.sleep(poll)
+        return self.latest()
+
+    def close(self):
+        self.map.close()
+        self.file.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc_info):
+        self.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("path")
+    parser.add_argument("--save", help="save the latest frame to this image file (needs Pillow)")
+    args = parser.parse_args()
+
+    with FrameReader(args.path) as frames:
+        if args.save:
+            frame = frames.latest()
+            if frame is None:
+                sys.exit("no frame captured yet")
+            frame.to_image().save(args.save)
+            return
+        try:
+            while True:
+                frame = frames.wait()
+                print(f"frame {frame.number} tick {frame.tick} region {frame.width}x{frame.height}"
+                      f"+{frame.x}+{frame.y} changed {frame.changed}", flush=True)
+        except KeyboardInterrupt:
+            pass
+
+
+if __name__ == "__main__":
+    main()
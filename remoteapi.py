@@ -1,6 +1,3 @@
-import threading
-import win32file
-import pywintypes
 import os
 import SynapseScape.api.lib.injector as injector
 # import SynapseScape.api.RSReflection as RSReflection
@@ -10,15 +7,13 @@ from SynapseScape.spatial.world_point import WorldPoint
 
 from SynapseScape.utilities.geometry import Rectangle
 from SynapseScape.interaction.remoteio import find_game_client_pid
+from asyncremoteapi import SyncRemoteAPI, PipeNotOpenError, Handle, JShellError, endpoint_for_pid
 
 world_point = re.compile(r"WorldPoint\(x=(\d+), y=(\d+), plane=(\d+)\)")
 rectangle = re.compile(r"java.awt.Rectangle\[x=(\d+),y=(\d+),width=(\d+),height=(\d+)\]")
 point = re.compile(r"java.awt.Point\[x=(\d+),y=(\d+)\]")
 int_array = re.compile(r"int\s*\[\d+\]\s*{\s*((?:\d+\s*,\s*)*\d+)\s*}")
 
-HANDSHAKE_READY = "READY"
-HANDSHAKE_GO_AHEAD = "GO_AHEAD"
-
 
 # TODO: relocate this function
 def is_integer(s):
@@ -28,21 +23,23 @@ def is_integer(s):
     except ValueError:
         return False
 
+def convert_value(result):
+    if isinstance(result, str):
+        if world_point.match(result):
+            return WorldPoint(*map(int, world_point.match(result).groups()))
+        elif rectangle.match(result):
+            return Rectangle(*map(int, rectangle.match(result).groups()))
+        elif point.match(result):
+            return [int(point.match(result).group(1)), int(point.match(result).group(2))]
+        elif int_array.match(result):
+            return [int(i) for i in int_array.match(result).group(1).split(',')]
+        elif is_integer(result):
+            return int(result)
+        else: return result
+
 def convert(func):
     def wrapper(*args, **kwargs):
-        result = func(*args, **kwargs)
-        if isinstance(result, str):
-            if world_point.match(result):
-                return WorldPoint(*map(int, world_point.match(result).groups()))
-            elif rectangle.match(result):
-                return Rectangle(*map(int, rectangle.match(result).groups()))
-            elif point.match(result):
-                return [int(point.match(result).group(1)), int(point.match(result).group(2))]
-            elif int_array.match(result):
-                return [int(i) for i in int_array.match(result).group(1).split(',')]
-            elif is_integer(result):
-                return int(result)
-            else: return result
+        return convert_value(func(*args, **kwargs))
     return wrapper
 
 class JWrapper:
@@ -76,15 +73,209 @@ class ChainProxy:
         self.parent.method_chain.append(method_with_args)
         return self.parent
 
-class PipeNotOpenError(Exception):
-    """Raised when the pipe is not open for operations."""
-    
-    def __init__(self, message, data=None):
-        self.message = message
-        self.data = data  # Store additional data causing the issue
 
-    def __str__(self):
-        return f"{self.message}. Data causing the error: {self.data}"
+# Separates fused results in the single string a QueryBatch evaluation returns. JShell
+# shows it escaped (as \036) like any control character; unquote() turns it back.
+FUSED_SEPARATOR = "\u001e"
+
+# Local class declared inside every fused query. Formats each result the way JShell formats
+# a value on its own (the same as the $Tick helper on the server does), so a fused result
+# converts exactly like the response to the single query. Kept free of // comments: it is
+# sent as one line.
+FUSED_FORMATTER = r"""
+class $Fmt {
+    String value(Object value) {
+        if (value == null) { return "null"; }
+        if (value instanceof String) { return quote((String) value, '"'); }
+        if (value instanceof Character) { return quote(value.toString(), '\''); }
+        if (value.getClass().isArray()) {
+            Class<?> type = value.getClass();
+            int dimensions = 0;
+            while (type.isArray()) { type = type.getComponentType(); dimensions++; }
+            String name = type.getTypeName();
+            int length = java.lang.reflect.Array.getLength(value);
+            StringBuilder out = new StringBuilder(name.substring(name.lastIndexOf('.') + 1));
+            out.append('[').append(length).append(']');
+            for (int i = 1; i < dimensions; i++) { out.append("[]"); }
+            out.append(" { ");
+            for (int i = 0; i < length; i++) {
+                out.append(i > 0 ? ", " : "").append(value(java.lang.reflect.Array.get(value, i)));
+            }
+            return out.append(length > 0 ? " }" : "}").toString();
+        }
+        return value.toString();
+    }
+    String quote(String text, char delimiter) {
+        StringBuilder out = new StringBuilder().append(delimiter);
+        for (int i = 0; i < text.length(); i++) {
+            char c = text.charAt(i);
+            switch (c) {
+            case '\b': out.append("\\b"); break;
+            case '\t': out.append("\\t"); break;
+            case '\n': out.append("\\n"); break;
+            case '\f': out.append("\\f"); break;
+            case '\r': out.append("\\r"); break;
+            default:
+                if (c == delimiter || c == '\\') {
+                    out.append('\\').append(c);
+                } else if (c < 256 && Character.isISOControl(c)) {
+                    out.append(String.format("\\%03o", (int) c));
+                } else {
+                    out.append(c);
+                }
+            }
+        }
+        return out.append(delimiter).toString();
+    }
+}
+"""
+FUSED_FORMATTER = " ".join(line.strip() for line in FUSED_FORMATTER.strip().splitlines())
+
+# Java escapes in a value JShell shows as a String literal.
+java_escape = re.compile(r"""\\([btnfr"'\\]|[0-3][0-7]{2}|[0-7]{1,2})""")
+JAVA_ESCAPES = {"b": "\b", "t": "\t", "n": "\n", "f": "\f", "r": "\r"}
+
+
+class Deferred:
+    """Result slot of a chain recorded in a QueryBatch; filled in when the batch executes."""
+
+    def __init__(self, query):
+        self.query = query
+        self._value = None
+        self._resolved = False
+
+    def resolve(self, value):
+        self._value = value
+        self._resolved = True
+
+    @property
+    def value(self):
+        if not self._resolved:
+            raise RuntimeError(f"Query has not been executed yet: {self.query}")
+        return self._value
+
+    def __repr__(self):
+        return f"Deferred({self.query!r}, {self._value!r})" if self._resolved else f"Deferred({self.query!r})"
+
+
+class BatchChain:
+    """Immutable method chain rooted at a JShell variable, recorded instead of sent."""
+
+    def __init__(self, batch, root, steps=(), pending=None):
+        self._batch = batch
+        self._root = root
+        self._steps = steps
+        self._pending = pending
+
+    def __getattr__(self, name):
+        if name.startswith('_'):
+            raise AttributeError(name)
+        steps = self._steps if self._pending is None else self._steps + (self._pending,)
+        return BatchChain(self._batch, self._root, steps, name)
+
+    def __call__(self, *args):
+        args_str = ', '.join(map(str, args))
+        return BatchChain(self._batch, self._root, self._steps + (f"{self._pending}({args_str})",))
+
+    def execute(self):
+        """Record this chain in the batch; the returned Deferred resolves when the batch runs."""
+        steps = self._steps if self._pending is None else self._steps + (self._pending,)
+        return self._batch.add(self._root, steps)
+
+
+class QueryBatch:
+    """Collects many chains and evaluates them in one round trip.
+
+    Chains are compiled into a single JShell expression. Every distinct prefix, such as
+    client.getLocalPlayer() shared by several chains, is computed once into a local; a null
+    prefix makes its dependents null instead of throwing. The results come back as one
+    string and are split, converted and assigned to their Deferreds.
+
+        with QueryBatch() as q:
+            client = q.root("client")
+            state = client.getGameState().execute()
+            location = client.getLocalPlayer().getWorldLocation().execute()
+            plane = client.getPlane().execute()
+        print(state.value, location.value, plane.value)
+
+    Pending JWrapper chains can be recorded as well with add_wrapper().
+    """
+
+    def __init__(self, api=None, priority=None):
+        self.api = api or RemoteAPI()
+        self.priority = priority
+        self.chains = []
+
+    def root(self, name):
+        return BatchChain(self, name)
+
+    def add(self, root, steps):
+        deferred = Deferred(f"{root}." + ".".join(steps) if steps else root)
+        self.chains.append((root, tuple(steps), deferred))
+        return deferred
+
+    def add_wrapper(self, wrapper: JWrapper):
+        """Take over the chain a JWrapper has accumulated instead of executing it."""
+        steps = tuple(wrapper.method_chain)
+        wrapper.method_chain = []
+        return self.add(wrapper.targetClass, steps)
+
+    def compile(self, chains=None):
+        locals_by_prefix = {}
+        lines = []
+        outputs = []
+        for root, steps, _ in (self.chains if chains is None else chains):
+            current = root
+            for depth in range(1, len(steps) + 1):
+                key = (root,) + steps[:depth]
+                if key not in locals_by_prefix:
+                    name = f"$q{len(locals_by_prefix)}"
+                    previous = current
+                    if depth == 1:
+                        lines.append(f"var {name} = {previous}.{steps[0]};")
+                    else:
+                        lines.append(f"var {name} = {previous} == null ? null : {previous}.{steps[depth - 1]};")
+                    locals_by_prefix[key] = name
+                current = locals_by_prefix[key]
+            outputs.append(f"$f.value({current})")
+
+        body = " ".join(lines)
+        joined = ' + "\\u001e" + '.join(outputs)
+        return (f"((java.util.function.Supplier<String>) () -> {{ {FUSED_FORMATTER} $Fmt $f = new $Fmt(); "
+                f"{body} return {joined}; }}).get()")
+
+    @staticmethod
+    def unquote(value):
+        # JShell shows a String value as a literal: quotes, backslashes and control
+        # characters are escaped, the latter in octal (\036 for the separator).
+        if len(value) >= 2 and value[0] == '"' and value[-1] == '"':
+            def decode(match):
+                escape = match.group(1)
+                if escape[0] in "01234567":
+                    return chr(int(escape, 8))
+                return JAVA_ESCAPES.get(escape, escape)
+            return java_escape.sub(decode, value[1:-1])
+        return value
+
+    def execute(self):
+        if not self.chains:
+            return []
+        chains, self.chains = self.chains, []
+        query = self.compile(chains)
+        response = self.api.connection.query(query, self.priority)
+        values = self.unquote(response).split(FUSED_SEPARATOR)
+        if len(values) != len(chains):
+            raise RuntimeError(f"Fused query returned {len(values)} results for {len(chains)} chains: {response}")
+        for (_, _, deferred), value in zip(chains, values):
+            deferred.resolve(convert_value(value))
+        return [deferred.value for _, _, deferred in chains]
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc_type, exc_value, traceback):
+        if exc_type is None:
+            self.execute()
 
 class RemoteAPI:
     _instance = None
@@ -98,136 +289,83 @@ class RemoteAPI:
     def __init__(self, encoding='utf-8'):
         if RemoteAPI._initialized:
             return
+        pid = None
         try:
             pid = find_game_client_pid()
             print(f"Found game client PID: {pid}")
-            if injector.Injector.inject(os.path.join(os.path.dirname(os.path.abspath(__file__)), "lib/JShell.dll"), find_game_client_pid()):
+            if injector.Injector.inject(os.path.join(os.path.dirname(os.path.abspath(__file__)), "lib/JShell.dll"), pid):
                 print("Successfully injected JShell.dll")
 
             # injector.inject(os.path.join(os.path.dirname(os.path.abspath(__file__)), "RSReflection.dll"), find_game_client_pid())
         except Exception as e:
             print("Error injecting JShell.dll: ", e)
-        self.pipe_name = r'\\.\pipe\jshellpipe'
-        self.handle = None
-        self.encoding = encoding
-        self.lock = threading.Lock()  # For thread safety
+        # One persistent connection; concurrent callers are pipelined on it instead of
+        # queueing behind a lock and reopening the pipe for every query. Each client serves
+        # its own pipe, so connect to the one that was injected.
+        self.connection = SyncRemoteAPI(endpoint=endpoint_for_pid(pid) if pid else None, encoding=encoding)
         self.init_jshell()
         RemoteAPI._initialized = True
 
-    def write_to_pipe(self, message: str) -> bool:
-        with self.lock:
-            if not self.handle:
-                raise PipeNotOpenError("Pipe is not open for writing", message)
-            try:
-                win32file.WriteFile(self.handle, message.encode(self.encoding))
-                return True
-            except Exception as e:
-                print(f"Error writing to pipe: {e}")
-                return False
-
-    import time
-
-    def read_from_pipe(self, buffer_size=32768) -> str:
-        with self.lock:
-            try:
-                time.sleep(0.1)  # wait for 100ms
-                result, data = win32file.ReadFile(self.handle, buffer_size)
-                return data.decode(self.encoding)
-            except Exception as e:
-                print(f"Error reading from pipe: {e}")
-                return None
-
-    def __enter__(self):
-        with self.lock:
-            retries = 20  # or however many retries you deem appropriate
-
-            for _ in range(retries):
-                try:
-                    self.handle = win32file.CreateFile(
-                        self.pipe_name,
-                        win32file.GENERIC_READ | win32file.GENERIC_WRITE,
-                        0,
-                        None,
-                        win32file.OPEN_EXISTING,
-                        0,
-                        None
-                    )
-                    return self  # connection succeeded, break out of the loop
-                except pywintypes.error as e:
-                    if "All pipe instances are busy" in str(e):
-                        time.sleep(0.1)
-                        continue  # retry immediately
-                    else:
-                        print(str(e))
-                        raise PipeNotOpenError(f"Could not open pipe", self.pipe_name) from e
-
-            # If you reach here, all retries failed
-            raise PipeNotOpenError(f"Could not open pipe after {retries} retries", self.pipe_name)
-
-
-    def __exit__(self, exc_type, exc_value, traceback):
-        with self.lock:
-            if self.handle:
-                try:
-                    win32file.CloseHandle(self.handle)
-                    self.handle = None
-                except Exception as e:
-                    print(f"Error closing pipe: {e}")
-
     @convert
-    def query(self, script: str):
-        assert isinstance(script, str)
-        if not script[-1] == ';':
-            script += ';'
-        with self:
-            # Start the handshake process
-            self.write_to_pipe(HANDSHAKE_READY)
-            handshake_response = self.read_from_pipe()
-            if handshake_response != HANDSHAKE_GO_AHEAD:
-                raise Exception("Handshake failed. Expected GO_AHEAD but received: " + handshake_response)
-            # Handshake successful, send actual data
-            self.write_to_pipe(script)
-            response = self.read_from_pipe()
-        return response
+    def query(self, script: str, priority: str = None, cache=None):
+        """Evaluate a snippet. priority is "interactive" (default) or "bulk"; bulk queries
+        yield to interactive ones in the server's scheduler. "tick" queries wait for the next
+        game tick and are read together on the client thread, so they agree with each other.
+        cache="tick" or a number of seconds lets the server reuse the result of a read, e.g.
+        api.query("client.getPlane()", cache="tick")"""
+        return self.connection.query(script, priority, cache)
+
+    def handle(self, script: str, priority: str = None) -> Handle:
+        """Keep the result of script on the server, e.g.
+        tiles = api.handle("client.getScene().getTiles()")
+        api.query(f"{tiles}[0][50][50].getGameObjects()")"""
+        return self.connection.handle(script, priority)
+
+    def release(self, handle: Handle):
+        self.connection.release(handle)
+
+    def declare(self, script: str):
+        """Evaluate a bootstrap declaration. Pinned snippets are never garbage collected
+        and are replayed if the server has to rebuild its shell."""
+        return self.query("<PIN>" + script)
 
-    
     def init_jshell(self):
-        self.query("import java.awt.Rectangle;")
-        self.query("import java.awt.Point;")
-        self.query("import java.awt.Polygon;")
-        self.query("import java.awt.Canvas;")
-        self.query("import net.runelite.api.coords.LocalPoint;")
-        self.query("import net.runelite.api.Perspective;")
-        self.query("import net.runelite.api.coords.WorldPoint;")
-        self.query("import net.runelite.api.Client;")
-        self.query("import net.runelite.api.Scene;")
-        self.query("import net.runelite.api.Tile;")
-        self.query("import net.runelite.api.coords.*;")
-        self.query("import net.runelite.api.*;")
-        self.query("import java.awt.Canvas;")
-        self.query("import java.lang.reflect.*;")
-        self.query("import net.runelite.api.TileObject;")
-        self.query("import net.runelite.api.GameObject;")
-        self.query("import net.runelite.api.WallObject;")
-        self.query("import net.runelite.api.DecorativeObject;")
-        self.query("import net.runelite.api.GroundObject;")
-        self.query("import java.util.*;")
-        self.query("import java.util.stream.Collectors;")
-        self.query("import java.util.stream.Stream;")
-        self.query("import net.runelite.api.InventoryID;")
-        self.query("import net.runelite.api.ItemContainer;")
-        self.query("import net.runelite.api.Item;")
-        self.query("import net.runelite.api.Item;")
-        self.query("import net.runelite.api.widgets.WidgetInfo;")
-        self.query("import net.runelite.api.widgets.Widget;")
-        self.query("import java.lang.Exception;")
-        self.query("import java.util.List;")
-        self.query("import java.util.ArrayList;")
-        self.query("import java.util.HashSet;")
-        self.query("import java.util.ArrayDeque;")
-        self.query("import java.util.Collections;")
-
-        self.query('''
+        self.declare("import java.awt.Rectangle;")
+        self.declare("import java.awt.Point;")
+        self.declare("import java.awt.Polygon;")
+        self.declare("import java.awt.Canvas;")
+        self.declare("import net.runelite.api.coords.LocalPoint;")
+        self.declare("import net.runelite.api.Perspective;")
+        self.declare("import net.runelite.api.coords.WorldPoint;")
+        self.declare("import net.runelite.api.Client;")
+        self.declare("import net.runelite.api.Scene;")
+        self.declare("import net.runelite.api.Tile;")
+        self.declare("import net.runelite.api.coords.*;")
+        self.declare("import net.runelite.api.*;")
+        self.declare("import java.awt.Canvas;")
+        self.declare("import java.lang.reflect.*;")
+        self.declare("import net.runelite.api.TileObject;")
+        self.declare("import net.runelite.api.GameObject;")
+        self.declare("import net.runelite.api.WallObject;")
+        self.declare("import net.runelite.api.DecorativeObject;")
+        self.declare("import net.runelite.api.GroundObject;")
+        self.declare("import java.util.*;")
+        self.declare("import java.util.stream.Collectors;")
+        self.declare("import java.util.stream.Stream;")
+        self.declare("import net.runelite.api.InventoryID;")
+        self.declare("import net.runelite.api.ItemContainer;")
+        self.declare("import net.runelite.api.Item;")
+        self.declare("import net.runelite.api.Item;")
+        self.declare("import net.runelite.api.widgets.WidgetInfo;")
+        self.declare("import net.runelite.api.widgets.Widget;")
+        self.declare("import java.lang.Exception;")
+        self.declare("import java.util.List;")
+        self.declare("import java.util.ArrayList;")
+        self.declare("import java.util.HashSet;")
+        self.declare("import java.util.ArrayDeque;")
+        self.declare("import java.util.Collections;")
+
+        self.declare('''
             public class Node {
                 WorldPoint data;
                 Node previous;
@@ -260,7 +398,7 @@ class RemoteAPI:
                 }
             }''')
 
-        self.query('''
+        self.declare('''
             public static List<WorldPoint> findPath(Client client, WorldPoint p) {
                 long start = System.currentTimeMillis();
                 WorldPoint starting = client.getLocalPlayer().getWorldLocation();
@@ -301,7 +439,7 @@ class RemoteAPI:
                 return null;
             }''')
 
-        self.query('''
+        self.declare('''
             public static Rectangle getTileClickbox(Client client, WorldPoint tile) {
                 LocalPoint lp = LocalPoint.fromWorld(client, tile);
                 Polygon p = null;
@@ -322,7 +460,7 @@ class RemoteAPI:
                 return p.getBounds();
             }''')
 
-        self.query('''
+        self.declare('''
             public static String findTileObject(Client client, int id) {
                 Scene scene = client.getScene();
                 Tile[][][] tiles = scene.getTiles();
@@ -0,0 +1,293 @@
+"""Replay a wire-traffic recording against a JShell server and compare latencies.
+
+Recordings are made by the server ("record start <path>" / "record stop"; see Recorder.hpp
+for the layout). Each recorded session is replayed on its own framed connection, requests
+are sent at their recorded offsets (scaled by --speed) without waiting for earlier
+responses, and latencies are compared per query shape -- the query text with literals and
+handle ids replaced by "?".
+
+Both sides are measured the same way: the recording holds the server's arrival-to-completion
+time of each request, so the replay run is recorded by the server too (into --replay-log, a
+temporary file by default) and its requests are matched back to the ones replay sent. With
+--mock the replayed column is the harness's own round trip.
+
+    python replay.py traffic.jsrl --endpoint /tmp/jshellpipe-1234.sock
+    python replay.py traffic.jsrl --speed 10          # ten times faster than recorded
+    python replay.py traffic.jsrl --speed 0           # as fast as possible
+    python replay.py traffic.jsrl --mock              # no server, check the harness itself
+    python replay.py traffic.jsrl --replay-log new.jsrl   # keep the replay run's recording
+    python replay.py traffic.jsrl --dump              # list the records
+
+Runs headless on Linux; only asyncremoteapi is required.
+"""
+import argparse
+import asyncio
+import json
+import os
+import re
+import statistics
+import struct
+import sys
+import tempfile
+import time
+from collections import defaultdict, namedtuple
+
+from asyncremoteapi import AsyncRemoteAPI, Handle, JShellError, default_endpoint
+
+# Mirrors RecordLogHeader / RecordHeader in Recorder.hpp
+LOG_HEADER = struct.Struct("<4sIQQ40x")
+RECORD_HEADER = struct.Struct("<IIIBBHQIIII")
+MAGIC = b"JSRL"
+
+PRIORITIES = {0: None, 1: "bulk", 2: "tick"}
+
+MEASURES = {
+    "server": "server arrival to completion",
+    "mock": "harness round trip (mock)",
+}
+
+Record = namedtuple("Record", "session request_id priority arrival_us latency_us request response")
+
+
+def read_log(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    magic, version, length, start_us = LOG_HEADER.unpack_from(data, 0)
+    if magic != MAGIC:
+        raise ValueError(f"{path} is not a JShell recording")
+    if version != 1:
+        raise ValueError(f"Unsupported recording version {version}")
+
+    records = []
+    offset = LOG_HEADER.size
+    end = min(length, len(data))
+    while offset + RECORD_HEADER.size <= end:
+        (record_length, session, request_id, priority, _flags, _reserved, arrival_us,
+         latency_us, request_length, response_length, _reserved2) = RECORD_HEADER.unpack_from(data, offset)
+        body = offset + RECORD_HEADER.size
+        request = data[body:body + request_length].decode("utf-8", "replace")
+        response = data[body + request_length:body + request_length + response_length].decode("utf-8", "replace")
+        records.append(Record(session, request_id, priority, arrival_us, latency_us, request, response))
+        offset += record_length
+    return start_us, records
+
+
+def shape(query):
+    query = re.sub(r'"(?:\\.|[^"\\])*"', '"?"', query)
+    query = re.sub(r"\$h\{\d+\}", "$h{?}", query)
+    query = re.sub(r"\b\d+(?:\.\d+)?[LlFfDd]?\b", "?", query)
+    query = re.sub(r"\s+", " ", query).strip()
+    return query[:120]
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(p * (len(ordered) - 1)))]
+
+
+class MockEvaluator:
+    """Answers with the recorded response after the recorded latency."""
+
+    def __init__(self, records):
+        self.answers = defaultdict(list)
+        for record in records:
+            self.answers[record.request].append(record)
+
+    async def query(self, script, priority=None):
+        queue = self.answers.get(script)
+        record = queue.pop(0) if queue else None
+        if record:
+            await asyncio.sleep(record.latency_us / 1e6)
+            return record.response
+        return ""
+
+    async def close(self):
+        pass
+
+
+def session_marker(session):
+    """A query that names a replay connection in the server's recording of the run."""
+    return f'"replay session {session}";'
+
+
+async def replay_session(client, session, records, speed, started, results):
+    handle_ids = {}  # recorded handle id -> handle id in this run
+
+    async def send(record):
+        request = Handle.token.sub(lambda m: f"$h{{{handle_ids.get(m.group(1), m.group(1))}}}", record.request)
+        begin = time.perf_counter()
+        try:
+            response = await client.query(request, PRIORITIES.get(record.priority))
+        except JShellError as e:
+            response = e.payload  # compared as recorded, errors included
+        elapsed_us = (time.perf_counter() - begin) * 1e6
+
+        recorded = Handle.token.fullmatch(record.response)
+        replayed = Handle.token.fullmatch(response or "")
+        if recorded and replayed:
+            handle_ids[recorded.group(1)] = replayed.group(1)
+        results.append(Result(session, request, shape(record.request), record.latency_us, elapsed_us,
+                              response == record.response))
+
+    pending = []
+    for record in records:
+        if speed > 0:
+            delay = started + record.arrival_us / 1e6 / speed - time.perf_counter()
+            if delay > 0:
+                await asyncio.sleep(delay)
+        if Handle.token.search(record.request):
+            # A handle must exist before it is used; let earlier requests finish first.
+            await asyncio.gather(*pending)
+            pending = []
+        pending.append(asyncio.ensure_future(send(record)))
+    await asyncio.gather(*pending)
+
+
+# One replayed request; replayed_us is replaced by the server's measure when the run was recorded.
+Result = namedtuple("Result", "session request shape recorded_us replayed_us matched")
+
+
+def server_latencies(results, log_path):
+    """Replaces each result's round trip with the latency the server recorded for it. Replay
+    connections are told apart by their marker query, and within a connection a request is
+    matched to the next recorded one with the same text (request ids follow send order)."""
+    _, replayed = read_log(log_path)
+    sessions = {}  # replay session -> server session
+    by_text = defaultdict(lambda: defaultdict(list))  # server session -> request -> latencies
+    for record in sorted(replayed, key=lambda r: (r.session, r.request_id)):
+        match = re.fullmatch(r'"replay session (\d+)";', record.request)
+        if match:
+            sessions[int(match.group(1))] = record.session
+        else:
+            by_text[record.session][record.request].append(record.latency_us)
+
+    measured, missing = [], 0
+    for result in sorted(results, key=lambda r: r.session):
+        request = result.request if result.request.endswith(";") else result.request + ";"
+        latencies = by_text[sessions.get(result.session)][request]
+        if latencies:
+            measured.append(result._replace(replayed_us=latencies.pop(0)))
+        else:
+            missing += 1
+    return measured, missing
+
+
+async def replay(records, endpoint, speed, mock, log_path):
+    sessions = defaultdict(list)
+    for record in records:
+        sessions[record.session].append(record)
+    # Records are logged as requests complete, so a slow request is written after faster
+    # ones that arrived later; replay them in the order they arrived.
+    for session_records in sessions.values():
+        session_records.sort(key=lambda r: (r.arrival_us, r.request_id))
+
+    control = None
+    if not mock:
+        control = await AsyncRemoteAPI(endpoint).connect()
+        response = await control.query(f"record start {log_path}")
+        if response != "recording":
+            await control.close()
+            raise RuntimeError(f"Could not record the replay run to {log_path}: {response}")
+
+    clients = {}
+    results = []
+    try:
+        for session in sessions:
+            if mock:
+                clients[session] = MockEvaluator(sessions[session])
+            else:
+                clients[session] = await AsyncRemoteAPI(endpoint).connect()
+                await clients[session].query(session_marker(session))
+
+        started = time.perf_counter()
+        await asyncio.gather(*(replay_session(clients[session], session, session_records, speed, started, results)
+                               for session, session_records in sessions.items()))
+        elapsed = time.perf_counter() - started
+    finally:
+        for client in clients.values():
+            await client.close()
+        if control:
+            await control.query("record stop")
+            await control.close()
+    return results, elapsed
+
+
+def report(results):
+    by_shape = defaultdict(list)
+    for result in results:
+        by_shape[result.shape].append((result.recorded_us, result.replayed_us, result.matched))
+
+    rows = []
+    for query_shape, samples in by_shape.items():
+        recorded = [s[0] for s in samples]
+        replayed = [s[1] for s in samples]
+        rows.append({
+            "shape": query_shape,
+            "count": len(samples),
+            "recorded_p50_ms": percentile(recorded, 0.5) / 1000,
+            "recorded_p99_ms": percentile(recorded, 0.99) / 1000,
+            "replayed_p50_ms": percentile(replayed, 0.5) / 1000,
+            "replayed_p99_ms": percentile(replayed, 0.99) / 1000,
+            "delta_mean_ms": (statistics.mean(replayed) - statistics.mean(recorded)) / 1000,
+            "response_mismatches": sum(1 for s in samples if not s[2]),
+        })
+    rows.sort(key=lambda row: row["replayed_p99_ms"] - row["recorded_p99_ms"], reverse=True)
+    return rows
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("recording")
+    parser.add_argument("--endpoint", default=default_endpoint())
+    parser.add_argument("--speed", type=float, default=1.0, help="pacing multiplier, 0 = no pacing")
+    parser.add_argument("--mock", action="store_true", help="answer from the recording instead of a server")
+    parser.add_argument("--dump", action="store_true", help="print the records and exit")
+    parser.add_argument("--json", action="store_true", help="print the report as JSON")
+    parser.add_argument("--replay-log", help="where the server records the replay run (default: a temporary file)")
+    args = parser.parse_args()
+
+    start_us, records = read_log(args.recording)
+    if args.dump:
+        for record in records:
+            print(f"{record.arrival_us / 1e6:10.3f}s session={record.session} id={record.request_id} "
+                  f"pri={record.priority} latency={record.latency_us / 1000:.2f}ms {record.request!r} -> {record.response!r}")
+        return 0
+
+    log_path = args.replay_log
+    if not log_path and not args.mock:
+        descriptor, log_path = tempfile.mkstemp(suffix=".jsrl")
+        os.close(descriptor)
+    try:
+        results, elapsed = asyncio.run(replay(records, args.endpoint, args.speed, args.mock, log_path))
+        missing = 0
+        if not args.mock:
+            results, missing = server_latencies(results, log_path)
+    finally:
+        if log_path and not args.replay_log:
+            os.remove(log_path)
+
+    measure = "mock" if args.mock else "server"
+    rows = report(results)
+    if args.json:
+        print(json.dumps({"requests": len(results), "unmatched": missing, "elapsed_s": elapsed,
+                          "recorded_measure": MEASURES["server"], "replayed_measure": MEASURES[measure],
+                          "shapes": rows}, indent=2))
+        return 0
+
+    print(f"Replayed {len(results)} requests in {elapsed:.2f}s "
+          f"(recorded span {records[-1].arrival_us / 1e6 if records else 0:.2f}s)")
+    print(f"Latencies: recorded = {MEASURES['server']}, replayed = {MEASURES[measure]}")
+    if missing:
+        print(f"{missing} replayed requests were not found in the server's recording and are left out")
+    print(f"{'count':>6} {'rec p50':>9} {'rec p99':>9} {'new p50':>9} {'new p99':>9} {'d mean':>9} {'diff':>5}  shape")
+    for row in rows:
+        print(f"{row['count']:>6} {row['recorded_p50_ms']:>9.2f} {row['recorded_p99_ms']:>9.2f} "
+              f"{row['replayed_p50_ms']:>9.2f} {row['replayed_p99_ms']:>9.2f} {row['delta_mean_ms']:>+9.2f} "
+              f"{row['response_mismatches']:>5}  {row['shape']}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())